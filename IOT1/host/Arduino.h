@@ -0,0 +1,140 @@
+// == Arduino shim cho bản build Linux (make host) ==
+// Chỉ những gì main.cpp + ArduinoJson (ARDUINOJSON_ENABLE_ARDUINO_STRING/_STREAM) cần:
+// String, Stream, Serial, random/randomSeed. Phần cứng/mạng đi qua hal::* (host/hal_linux.cpp)
+#pragma once
+
+#include <stdint.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+
+// ================== String ==================
+class String {
+public:
+  String(const char* s = "") : s_(s ? s : "") {}
+  String(const char* s, size_t n) : s_(s ? s : "", s ? n : 0) {}
+  explicit String(char c) : s_(1, c) {}
+  explicit String(int v) : s_(std::to_string(v)) {}
+  explicit String(unsigned v) : s_(std::to_string(v)) {}
+  explicit String(long v) : s_(std::to_string(v)) {}
+  explicit String(unsigned long v) : s_(std::to_string(v)) {}
+  explicit String(long long v) : s_(std::to_string(v)) {}
+  explicit String(unsigned long long v) : s_(std::to_string(v)) {}
+
+  // ArduinoJson gán nullptr trước khi serialize vào String
+  String& operator=(const char* s) { s_ = s ? s : ""; return *this; }
+
+  bool concat(const char* s) { if (!s) return false; s_ += s; return true; }
+  bool concat(const String& s) { s_ += s.s_; return true; }
+  bool concat(char c) { s_ += c; return true; }
+  String& operator+=(const char* s) { concat(s); return *this; }
+  String& operator+=(const String& s) { s_ += s.s_; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  const char* c_str() const { return s_.c_str(); }
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+  int indexOf(const char* needle, unsigned int from = 0) const {
+    size_t pos = s_.find(needle, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t pos = s_.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+  bool startsWith(const char* prefix) const { return s_.compare(0, strlen(prefix), prefix) == 0; }
+  String substring(unsigned int from) const { return from < s_.size() ? String(s_.c_str() + from) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from >= s_.size() || to <= from) return String();
+    return String(s_.c_str() + from, (to > s_.size() ? s_.size() : to) - from);
+  }
+  void trim() {
+    size_t b = s_.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) { s_.clear(); return; }
+    s_ = s_.substr(b, s_.find_last_not_of(" \t\r\n") - b + 1);
+  }
+
+  friend bool operator==(const String& a, const String& b) { return a.s_ == b.s_; }
+  friend bool operator==(const String& a, const char* b) { return a.s_ == (b ? b : ""); }
+  friend bool operator!=(const String& a, const String& b) { return !(a == b); }
+  friend bool operator!=(const String& a, const char* b) { return !(a == b); }
+  friend String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+  friend String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+  friend String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+
+private:
+  std::string s_;
+};
+
+// ArduinoJson nhận cả StringSumHelper (kết quả của a + b trên Arduino)
+class StringSumHelper : public String {
+public:
+  using String::String;
+};
+
+// ================== Stream ==================
+// Đủ cho ArduinoJson đọc theo luồng (read/readBytes); body HTTP giả nằm ở host/hal_linux.cpp
+class Stream {
+public:
+  virtual ~Stream() {}
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t readBytes(char* buffer, size_t length) {
+    size_t n = 0;
+    int c;
+    while (n < length && (c = read()) >= 0) buffer[n++] = (char)c;
+    return n;
+  }
+};
+
+// ================== Serial ==================
+class HostSerial {
+public:
+  bool muted = false;   // --quiet: bỏ log để benchmark không đo stdout
+  uint64_t bytes = 0;   // số byte firmware in ra (kể cả khi muted) → chi phí Serial 115200 baud
+  bool inputEof = false;
+
+  void begin(unsigned long) {}
+  // Đọc stdin không chặn (lệnh console của firmware); muted → không có người gõ, khỏi poll
+  int available() {
+    if (muted || inputEof) return 0;
+    pollfd p = {0, POLLIN, 0};
+    return poll(&p, 1, 0) > 0 ? 1 : 0;
+  }
+  int read() {
+    unsigned char c;
+    if (::read(0, &c, 1) != 1) { inputEof = true; return -1; }   // EOF (stdin đóng / /dev/null)
+    return c;
+  }
+  void print(const char* s) { bytes += strlen(s); if (!muted) fputs(s, stdout); }
+  void print(const String& s) { print(s.c_str()); }
+  void println() { print("\n"); }
+  void println(const char* s) { print(s); print("\n"); }
+  void println(const String& s) { println(s.c_str()); }
+  int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args; va_start(args, fmt);
+    int n = muted ? vsnprintf(nullptr, 0, fmt, args) : vfprintf(stdout, fmt, args);
+    va_end(args);
+    if (n > 0) bytes += n;
+    return n;
+  }
+};
+
+inline HostSerial Serial;
+
+// ================== random ==================
+inline std::mt19937& hostRandomEngine() { static std::mt19937 engine(1); return engine; }
+inline void randomSeed(unsigned long seed) { hostRandomEngine().seed((std::mt19937::result_type)seed); }
+inline long random(long lo, long hi) {
+  if (hi <= lo) return lo;
+  return lo + (long)(hostRandomEngine()() % (unsigned long)(hi - lo));
+}
+inline long random(long hi) { return random(0, hi); }
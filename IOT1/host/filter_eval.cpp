@@ -0,0 +1,133 @@
+// == Đánh giá bộ lọc slot trên trace đã ghi (include/slot_filter.h) ==
+// ./build/filter_eval TRACE.csv [--occupy CM] [--free CM] [--clamp CM] [--alpha A] [--confirm N]
+// TRACE: "ms,slot,echo_us,car" — parking_host --record-trace, hoặc log serial từ board kèm nhãn tay.
+// Phát lại từng mẫu qua 2 cách quyết định có xe/trống:
+//   - thô: 1 mẫu so với ngưỡng hysteresis (cách cũ của updateSlotStatus)
+//   - bộ lọc: SlotFilter với tham số trên dòng lệnh (mặc định = firmware)
+// In số lần đổi trạng thái đúng/sai (sai = không khớp một lần đổi thật của car), sai/giờ·slot,
+// số lần đổi thật bị bỏ sót và độ trễ phát hiện (từ mẫu đầu tiên thấy trạng thái mới)
+#include "slot_filter.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const int EVAL_MAX_SLOTS = 64;
+
+// Theo dõi một cách quyết định trên mọi slot
+struct Scorer {
+  const char* name;
+  int32_t  truth[EVAL_MAX_SLOTS] = {};
+  bool     awaiting[EVAL_MAX_SLOTS] = {};   // trạng thái thật đã đổi, chưa phát hiện
+  uint32_t changedMs[EVAL_MAX_SLOTS] = {};
+  uint64_t truthChanges = 0, detected = 0, falseFlips = 0;
+  std::vector<uint32_t> latencyMs;
+
+  void observe(int slot, uint32_t ms, int32_t car, int32_t est) {
+    if (car == truth[slot]) return;
+    truth[slot] = car;
+    truthChanges++;
+    changedMs[slot] = ms;
+    awaiting[slot] = car != est;   // đổi 2 lần liền mà chưa phát hiện → về khớp, lần trước tính bỏ sót
+  }
+  void flipped(int slot, uint32_t ms, int32_t est) {
+    if (est == truth[slot] && awaiting[slot]) {
+      detected++;
+      latencyMs.push_back(ms - changedMs[slot]);
+      awaiting[slot] = false;
+    } else {
+      falseFlips++;                // đổi sai, hoặc đổi lại sau một lần đổi sai
+      awaiting[slot] = false;
+    }
+  }
+  uint32_t latencyAt(double q) {
+    if (latencyMs.empty()) return 0;
+    std::sort(latencyMs.begin(), latencyMs.end());
+    return latencyMs[std::min((size_t)(q * latencyMs.size()), latencyMs.size() - 1)];
+  }
+  void print(double slotHours) {
+    printf("  %-12s %8llu %7llu %7llu %12.2f %8llu %7u/%u/%u\n", name,
+           (unsigned long long)(detected + falseFlips), (unsigned long long)detected,
+           (unsigned long long)falseFlips, slotHours > 0 ? falseFlips / slotHours : 0.0,
+           (unsigned long long)(truthChanges - detected), latencyAt(0.50), latencyAt(0.95), latencyAt(1.0));
+  }
+};
+
+static void usage(const char* prog) {
+  printf("Usage: %s TRACE.csv [--occupy CM] [--free CM] [--clamp CM] [--alpha A] [--confirm N]\n", prog);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) { usage(argv[0]); return 1; }
+  const char* path = argv[1];
+  FilterParams params;
+  for (int i = 2; i < argc; i++) {
+    const char* arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(arg, "--occupy") && hasValue) params.occupyCm = (float)atof(argv[++i]);
+    else if (!strcmp(arg, "--free") && hasValue) params.freeCm = (float)atof(argv[++i]);
+    else if (!strcmp(arg, "--clamp") && hasValue) params.clampCm = (float)atof(argv[++i]);
+    else if (!strcmp(arg, "--alpha") && hasValue) params.alpha = (float)atof(argv[++i]);
+    else if (!strcmp(arg, "--confirm") && hasValue) params.confirm = atoi(argv[++i]);
+    else { usage(argv[0]); return 1; }
+  }
+
+  FILE* f = fopen(path, "r");
+  if (!f) { fprintf(stderr, "Không mở được %s\n", path); return 1; }
+  char line[128];
+  if (!fgets(line, sizeof(line), f)) { fprintf(stderr, "%s rỗng\n", path); return 1; }
+
+  static SlotFilter<EVAL_MAX_SLOTS> filter;
+  filter.reset(params);
+  static int32_t sampleMm[EVAL_MAX_SLOTS], fresh[EVAL_MAX_SLOTS];
+  int32_t rawOccupied[EVAL_MAX_SLOTS] = {};
+  uint32_t firstMs[EVAL_MAX_SLOTS], lastMs[EVAL_MAX_SLOTS];
+  bool seen[EVAL_MAX_SLOTS] = {};
+  Scorer raw, filtered;
+  raw.name = "thô (1 mẫu)";
+  filtered.name = "median+EMA";
+  uint64_t samples = 0;
+
+  unsigned ms, slot, echoUs;
+  int car;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "%u,%u,%u,%d", &ms, &slot, &echoUs, &car) != 4 || slot >= (unsigned)EVAL_MAX_SLOTS) continue;
+    samples++;
+    if (!seen[slot]) { seen[slot] = true; firstMs[slot] = ms; }
+    lastMs[slot] = ms;
+    float cm = echoToCM(echoUs);
+
+    // Trạng thái thật đổi được thấy ở mẫu này → cả 2 cách bắt đầu tính trễ từ đây
+    raw.observe(slot, ms, car != 0, rawOccupied[slot]);
+    filtered.observe(slot, ms, car != 0, filter.occupied[slot]);
+
+    int32_t prev = rawOccupied[slot];
+    rawOccupied[slot] = prev ? cm < params.freeCm : cm < params.occupyCm;
+    if (rawOccupied[slot] != prev) raw.flipped(slot, ms, rawOccupied[slot]);
+
+    sampleMm[slot] = cmToMm(cm); fresh[slot] = 1;
+    filter.step(sampleMm, fresh, params);
+    fresh[slot] = 0;
+    if (filter.changed[slot]) filtered.flipped(slot, ms, filter.occupied[slot]);
+  }
+  fclose(f);
+
+  int slots = 0;
+  double slotHours = 0;
+  for (int i = 0; i < EVAL_MAX_SLOTS; i++) {
+    if (!seen[i]) continue;
+    slots++;
+    slotHours += (lastMs[i] - firstMs[i]) / 3600000.0;
+  }
+  printf("📊 Bộ lọc slot trên %s: %llu mẫu, %d slot, %.2f giờ·slot\n", path,
+         (unsigned long long)samples, slots, slotHours);
+  printf("  tham số: occupy=%.1fcm free=%.1fcm clamp=%.1fcm alpha=%.2f confirm=%d window=%d\n",
+         params.occupyCm, params.freeCm, params.clampCm, params.alpha, params.confirm, FILTER_WINDOW);
+  printf("  %-12s %8s %7s %7s %12s %8s %s\n", "cách", "đổi", "đúng", "sai", "sai/giờ·slot", "bỏ sót",
+         "trễ p50/p95/max ms");
+  raw.print(slotHours);
+  filtered.print(slotHours);
+  return 0;
+}
@@ -0,0 +1,50 @@
+// == Điều khiển riêng của HAL Linux (host_main.cpp dùng, firmware không thấy) ==
+#pragma once
+
+#include <stdint.h>
+
+namespace hal {
+namespace host {
+
+struct Options {
+  bool     realtime      = false;  // false: đồng hồ ảo, delay/trigger/HTTP chỉ cộng thời gian
+  uint32_t seed          = 1;
+  uint32_t httpLatencyMs = 120;    // độ trễ mỗi request của backend giả
+  uint32_t tlsHandshakeMs = 1500;  // TCP + TLS handshake (ESP32 mất cỡ 1–2s)
+  uint32_t serverKeepAliveMs = 5000;  // server đóng kết nối rảnh (Node keepAliveTimeout)
+  bool     slotEventRoute = true;   // false: server cũ chưa có POST /api/parking/slot-event (404)
+  bool     bulkStatusRoute = true;  // false: server cũ chưa có PUT /api/slots/status (404)
+  uint32_t wifiDownEveryS = 0;     // > 0: cứ mỗi chu kỳ này mất WiFi wifiDownForS giây (cuối chu kỳ)
+  uint32_t wifiDownForS   = 0;
+  const char* journalPath = nullptr;  // file giả flash journal (giữ qua các lần chạy); nullptr = RAM
+  uint32_t flashBytes     = 65536;    // cùng cỡ phân vùng journal trong partitions.csv
+  uint32_t tokenTtlS      = 86400;    // hạn JWT của backend giả (backend thật: expiresIn 24h)
+  uint32_t glitchPct      = 0;        // % lần đo bắt đầu một loạt 1–3 mẫu sai (echo lạc / mất echo)
+  const char* tracePath   = nullptr;  // ghi mọi lần đo "ms,slot,echo_us,car" cho host/filter_eval.cpp
+};
+
+void configure(const Options& options);
+// Đồng hồ ảo: dùng khi loop() rảnh (không delay/đo/gọi HTTP) để thời gian vẫn trôi
+void advanceUs(uint64_t us);
+
+// Bộ đếm cho benchmark
+uint64_t pingCount();       // số lần ultrasonicEchoUs
+uint64_t httpCount();       // số request tới backend giả (mọi thread)
+uint64_t loopHttpCount();   // số request gọi ngay trong thread chính (loop() bị chặn)
+uint64_t blockedUs();       // tổng thời gian thread chính bị chặn trong delay/trigger/HTTP
+uint64_t flashErases();     // số lần xoá sector flash
+uint64_t expiredTokenRejects();   // request bị 401 vì token hết hạn (firmware refresh trễ)
+
+// Đếm malloc/new của firmware: mọi thread, sau startAllocCount(), trừ phần trong Uncounted
+// (HAL giả, phần đo của host_main — những thứ không có trên board)
+void startAllocCount();
+uint64_t allocCount();
+struct Uncounted {          // thread hiện tại không bị đếm trong scope này
+  Uncounted();
+  ~Uncounted();
+  Uncounted(const Uncounted&) = delete;
+  Uncounted& operator=(const Uncounted&) = delete;
+};
+
+}  // namespace host
+}  // namespace hal
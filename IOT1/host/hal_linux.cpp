@@ -0,0 +1,590 @@
+// == HAL cho Linux (make host) ==
+// - Đồng hồ ảo mặc định: delay và HTTP chỉ cộng thời gian → chạy nhanh,
+//   tất định theo seed; --realtime thì ngủ thật theo steady_clock.
+//   Thread nền (network task) không tự đẩy đồng hồ: nó chờ tới khi loop() của thread chính
+//   đưa thời gian ảo tới hạn, như một core khác chạy song song. Ngược lại thread chính chỉ
+//   đẩy đồng hồ khi mọi thread nền đang chờ (CPU của nó coi như tốn 0µs) → kết quả không
+//   phụ thuộc scheduler của máy dev
+// - Cảm biến giả: mỗi slot luân phiên trống/có xe với thời gian ngẫu nhiên
+// - Backend giả trong process: trả JSON cùng dạng với backend Node (success/data/...)
+// - Mất WiFi theo chu kỳ (--wifi-down-every/--wifi-down-for): HTTP trả lỗi transport
+// - Flash journal: file (--journal) hoặc RAM, ghi kiểu NOR (AND), xoá sector về 0xFF
+// - Đếm malloc/new của firmware sau setup() (HAL giả và host_main không tính) → kiểm chứng
+//   firmware chạy ổn định không cấp phát heap
+#include "hal.h"
+#include "hal_host.h"
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const uint32_t HOST_HEAP_BYTES  = 327680;        // DRAM heap cỡ ESP32 sau khi boot WiFi
+static const time_t   HOST_EPOCH_START = 1763424000;    // 2025-11-18T00:00:00Z
+static const char*    HOST_ADMIN_ID    = "00000000-0000-4000-8000-000000000000";
+static const uint32_t HOST_FLASH_WRITE_US = 100;      // ghi 64B vào SPI flash
+static const uint32_t HOST_FLASH_ERASE_US = 45000;    // xoá 1 sector 4KB
+static const uint32_t HOST_CPU_MHZ = 240;             // hal::cycles() giả như ESP32 240MHz
+
+// Biển số đã đăng ký user (một phần DATABASE[] trong main.cpp → có cả nhánh 404)
+static const char* const HOST_PLATES[] = {"51D-22222", "51A-12345", "99A-99999"};
+static const int HOST_PLATE_COUNT = sizeof(HOST_PLATES) / sizeof(HOST_PLATES[0]);
+
+static hal::host::Options g_options;
+static const std::chrono::steady_clock::time_point g_start = std::chrono::steady_clock::now();
+static std::thread::id g_mainThread;
+static std::atomic<uint64_t> g_virtualUs{0};
+static uint64_t g_blockedUs = 0;                  // chỉ tính thread chính (loop())
+static uint64_t g_pings = 0;                      // số lần trigger
+static uint64_t g_loopHttpRequests = 0;           // HTTP gọi ngay trong thread chính
+static std::atomic<uint64_t> g_httpRequests{0};
+static uint64_t g_expiredRejects = 0;             // 401 vì token hết hạn
+static hal::HttpStats g_httpStats = {};
+static std::string g_connKey;          // host của kết nối keep-alive đang mở
+static uint64_t g_lastUseUs = 0;
+static std::vector<uint8_t> g_flash;   // nội dung vùng journal (ghi ra file nếu có --journal)
+static FILE* g_flashFile = nullptr;
+static uint64_t g_flashErases = 0;
+// Một mutex/condvar cho đồng hồ ảo và mọi hàng đợi. Cấp phát và không giải phóng:
+// thread nền còn chờ lúc main() return
+static std::mutex& g_sched = *new std::mutex;
+static std::condition_variable& g_schedCv = *new std::condition_variable;
+static int g_runningBackground = 0;                                  // thread nền không ở điểm chờ
+static std::vector<const std::function<bool()>*>& g_parked = *new std::vector<const std::function<bool()>*>;
+
+// ================== ĐẾM CẤP PHÁT ==================
+// malloc/calloc/realloc của cả process đi qua đây (operator new của libstdc++ gọi malloc).
+// Chỉ đếm sau startAllocCount() và ngoài hal::host::Uncounted (thread hiện tại)
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+
+static std::atomic<bool> g_allocCounting{false};
+static std::atomic<uint64_t> g_firmwareAllocs{0};
+static thread_local int t_uncounted = 0;
+
+static void countAlloc() {
+  if (g_allocCounting.load(std::memory_order_relaxed) && t_uncounted == 0) g_firmwareAllocs++;
+}
+
+extern "C" void* malloc(size_t size) noexcept { countAlloc(); return __libc_malloc(size); }
+extern "C" void* calloc(size_t n, size_t size) noexcept { countAlloc(); return __libc_calloc(n, size); }
+extern "C" void* realloc(void* ptr, size_t size) noexcept { countAlloc(); return __libc_realloc(ptr, size); }
+
+// ================== THỜI GIAN ==================
+static bool onMainThread() { return std::this_thread::get_id() == g_mainThread; }
+
+static uint64_t nowUs() {
+  if (!g_options.realtime) return g_virtualUs.load();
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_start).count();
+}
+
+// Mọi thread nền đang chờ và chưa cái nào có điều kiện thoả (đã được đánh thức nhưng chưa chạy)
+static bool backgroundQuiet() {
+  if (g_runningBackground > 0) return false;
+  for (const std::function<bool()>* ready : g_parked) if ((*ready)()) return false;
+  return true;
+}
+
+// Thread nền chờ tới khi ready() (gọi khi đang giữ g_sched)
+static void backgroundWait(std::unique_lock<std::mutex>& lock, const std::function<bool()>& ready) {
+  g_runningBackground--;
+  g_parked.push_back(&ready);
+  g_schedCv.notify_all();
+  g_schedCv.wait(lock, ready);
+  g_parked.erase(std::find(g_parked.begin(), g_parked.end(), &ready));
+  g_runningBackground++;
+}
+
+static void advanceVirtual(uint64_t us) {
+  std::unique_lock<std::mutex> lock(g_sched);
+  g_schedCv.wait(lock, backgroundQuiet);
+  g_virtualUs += us;
+  g_schedCv.notify_all();
+}
+
+static void block(uint64_t us) {
+  hal::host::Uncounted uncounted;
+  bool main = onMainThread();
+  if (main) g_blockedUs += us;
+  if (g_options.realtime) { std::this_thread::sleep_for(std::chrono::microseconds(us)); return; }
+  if (main) { advanceVirtual(us); return; }
+  std::unique_lock<std::mutex> lock(g_sched);
+  uint64_t until = g_virtualUs.load() + us;
+  backgroundWait(lock, [until] { return g_virtualUs.load() >= until; });
+}
+
+// ================== HÀNG ĐỢI ==================
+struct HostQueue {
+  std::deque<std::vector<uint8_t>> items;
+  uint16_t length;
+  uint16_t itemSize;
+};
+
+// Chờ ready() tối đa timeoutMs; thread nền ở chế độ đồng hồ ảo tính timeout theo thời gian ảo
+static bool waitFor(std::unique_lock<std::mutex>& lock, uint32_t timeoutMs, const std::function<bool()>& ready) {
+  if (ready()) return true;
+  if (timeoutMs == 0) return false;   // loop() poll: không vào futex
+  if (!g_options.realtime && !onMainThread()) {
+    uint64_t until = timeoutMs == hal::WAIT_FOREVER ? UINT64_MAX : g_virtualUs.load() + timeoutMs * 1000ULL;
+    backgroundWait(lock, [&ready, until] { return ready() || g_virtualUs.load() >= until; });
+    return ready();
+  }
+  if (timeoutMs == hal::WAIT_FOREVER) { g_schedCv.wait(lock, ready); return true; }
+  return g_schedCv.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready);
+}
+
+// ================== CẢM BIẾN GIẢ ==================
+struct FakeSensor {
+  std::mt19937 rng;
+  bool     car;
+  uint32_t nextChangeMs;
+  bool     pending;
+  uint64_t startUs;    // lúc trigger
+  uint64_t doneAtUs;   // lúc "ngắt" cạnh xuống của echo xảy ra
+  uint32_t echoUs;
+  uint8_t  glitchLeft;  // số mẫu sai còn lại của loạt nhiễu hiện tại
+};
+static FakeSensor g_sensors[HAL_MAX_DEVICES];
+static FILE* g_trace = nullptr;
+
+static uint32_t uniform(std::mt19937& rng, uint32_t lo, uint32_t hi) {
+  return std::uniform_int_distribution<uint32_t>(lo, hi)(rng);
+}
+// Trống 10–40s, có xe 20–90s
+static uint32_t dwellMs(FakeSensor& s) { return s.car ? uniform(s.rng, 20000, 90000) : uniform(s.rng, 10000, 40000); }
+
+// ================== BACKEND GIẢ ==================
+static long long g_nextHistoryId = 1000;
+struct OpenHistory { std::string userId; std::string slotId; };
+static std::map<long long, OpenHistory> g_openHistory;   // historyId → phiên đang mở
+static std::map<std::string, std::string> g_eventReplies;   // event_id → response đã trả (gửi lại không ghi trùng)
+
+// Lấy giá trị "key": "..." hoặc "key": 123 từ body JSON phẳng
+static std::string jsonField(const std::string& body, const char* key) {
+  std::string needle = std::string("\"") + key + "\":";
+  size_t pos = body.find(needle);
+  if (pos == std::string::npos) return "";
+  pos += needle.size();
+  if (pos < body.size() && body[pos] == '"') {
+    size_t end = body.find('"', pos + 1);
+    return end == std::string::npos ? "" : body.substr(pos + 1, end - pos - 1);
+  }
+  size_t end = body.find_first_of(",}", pos);
+  return body.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+static time_t epochNow() { return HOST_EPOCH_START + (time_t)(nowUs() / 1000000); }
+
+static std::string isoNow() {
+  time_t t = epochNow();
+  struct tm tm; gmtime_r(&t, &tm);
+  char buf[32]; strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S.000Z", &tm);
+  return buf;
+}
+
+static std::string base64Url(const std::string& in) {
+  static const char* ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  std::string out;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (unsigned char c : in) {
+    acc = (acc << 8) | c; bits += 8;
+    while (bits >= 6) { bits -= 6; out += ALPHABET[(acc >> bits) & 63]; }
+  }
+  if (bits) out += ALPHABET[(acc << (6 - bits)) & 63];
+  return out;
+}
+
+// JWT như jsonwebtoken của backend (payload có iat/exp tính bằng giây, hạn --token-ttl);
+// chữ ký giả, chỉ cần token khác nhau mỗi lần login
+static std::map<std::string, time_t> g_tokens;   // token đã cấp → exp
+static std::string issueToken() {
+  time_t iat = epochNow(), exp = iat + g_options.tokenTtlS;
+  std::string payload = std::string("{\"id\":\"") + HOST_ADMIN_ID + "\",\"role\":\"admin\",\"iat\":" +
+                        std::to_string(iat) + ",\"exp\":" + std::to_string(exp) + "}";
+  std::string token = base64Url("{\"alg\":\"HS256\",\"typ\":\"JWT\"}") + "." + base64Url(payload) + "." +
+                      base64Url("sig-" + std::to_string(g_tokens.size()));
+  g_tokens[token] = exp;
+  return token;
+}
+
+static std::string userIdForPlate(const std::string& plate) {
+  for (int i = 0; i < HOST_PLATE_COUNT; i++) {
+    if (plate == HOST_PLATES[i]) {
+      char id[40]; snprintf(id, sizeof(id), "00000000-0000-4000-8000-%012d", i + 1);
+      return id;
+    }
+  }
+  return "";
+}
+
+static int checkIn(const std::string& slotId, const std::string& userId, std::string& out) {
+  long long id = g_nextHistoryId++;
+  g_openHistory[id] = {userId, slotId};
+  out = "{\"success\":true,\"data\":{\"history\":{\"id\":" + std::to_string(id) + ",\"slot_id\":" +
+        slotId + ",\"user_id\":\"" + userId + "\",\"check_in_time\":\"" + isoNow() + "\"}}}";
+  return 201;
+}
+
+static int checkOut(std::map<long long, OpenHistory>::iterator it, std::string& out) {
+  if (it == g_openHistory.end()) { out = "{\"success\":false,\"message\":\"Không có phiên đỗ xe nào đang hoạt động\"}"; return 400; }
+  out = "{\"success\":true,\"data\":{\"history\":{\"id\":" + std::to_string(it->first) + ",\"user_id\":\"" +
+        it->second.userId + "\",\"check_out_time\":\"" + isoNow() + "\"}}}";
+  g_openHistory.erase(it);
+  return 200;
+}
+
+static int route(const std::string& method, const std::string& path, const std::string& body,
+                 const std::string& bearer, std::string& out) {
+  if (method == "POST" && path == "/api/auth/login") {
+    out = "{\"success\":true,\"data\":{\"token\":\"" + issueToken() + "\"}}";
+    return 200;
+  }
+  auto token = g_tokens.find(bearer);
+  if (token == g_tokens.end()) { out = "{\"success\":false,\"message\":\"Token không hợp lệ\"}"; return 401; }
+  if (epochNow() >= token->second) {
+    g_expiredRejects++;
+    out = "{\"success\":false,\"message\":\"jwt expired\"}";
+    return 401;
+  }
+
+  static const std::string platePath = "/api/users/license-plate/";
+  if (method == "GET" && path.compare(0, platePath.size(), platePath) == 0) {
+    std::string userId = userIdForPlate(path.substr(platePath.size()));
+    if (userId.empty()) { out = "{\"success\":false,\"message\":\"Không tìm thấy user\"}"; return 404; }
+    out = "{\"success\":true,\"data\":{\"id\":\"" + userId + "\"}}";
+    return 200;
+  }
+  if (method == "POST" && path == "/api/parking/checkin") {
+    std::string userId = jsonField(body, "user_id");
+    if (userId.empty()) userId = HOST_ADMIN_ID;   // như backend: thiếu user_id → user của JWT
+    return checkIn(jsonField(body, "slot_id"), userId, out);
+  }
+  if (method == "POST" && path == "/api/parking/checkout") {
+    return checkOut(g_openHistory.find(atoll(jsonField(body, "history_id").c_str())), out);
+  }
+  // Slot event gộp: tra biển số + check-in/check-out + trạng thái slot trong một request
+  if (method == "POST" && path == "/api/parking/slot-event" && g_options.slotEventRoute) {
+    std::string slotId = jsonField(body, "slot_id"), direction = jsonField(body, "direction");
+    std::string eventId = jsonField(body, "event_id");
+    auto seen = eventId.empty() ? g_eventReplies.end() : g_eventReplies.find(eventId);
+    if (seen != g_eventReplies.end()) { out = seen->second; return 200; }
+
+    int code;
+    if (direction == "in") {
+      std::string userId = userIdForPlate(jsonField(body, "license_plate"));
+      code = checkIn(slotId, userId.empty() ? HOST_ADMIN_ID : userId, out);
+    } else {
+      std::string historyId = jsonField(body, "history_id");
+      auto it = g_openHistory.begin();
+      if (!historyId.empty()) it = g_openHistory.find(atoll(historyId.c_str()));
+      else while (it != g_openHistory.end() && it->second.slotId != slotId) ++it;
+      code = checkOut(it, out);
+    }
+    if (!eventId.empty() && code < 300) g_eventReplies[eventId] = out;
+    return code;
+  }
+  if (method == "PUT" && path == "/api/slots/status") {
+    if (!g_options.bulkStatusRoute) { out = "{\"success\":false,\"message\":\"Not found\"}"; return 404; }
+    out = "{\"success\":true,\"data\":[]}";
+    return 200;
+  }
+  if (method == "PUT" && path.compare(0, 11, "/api/slots/") == 0) {
+    out = "{\"success\":true,\"data\":{\"status\":\"" + jsonField(body, "status") + "\"}}";
+    return 200;
+  }
+  out = "{\"success\":false,\"message\":\"Not found\"}";
+  return 404;
+}
+
+namespace hal {
+
+// ================== THỜI GIAN ==================
+uint32_t millis() { return (uint32_t)(nowUs() / 1000); }
+uint32_t micros() { return (uint32_t)nowUs(); }
+void delayMs(uint32_t ms) { block((uint64_t)ms * 1000); }
+void delayUs(uint32_t us) { block(us); }
+// CCOUNT giả theo đồng hồ ảo (thời gian firmware, không phải thời gian CPU của máy dev)
+uint32_t cycles() { return (uint32_t)(nowUs() * HOST_CPU_MHZ); }
+uint32_t cyclesPerUs() { return HOST_CPU_MHZ; }
+
+// ================== GPIO ==================
+void pinOutput(uint8_t) {}
+void pinInput(uint8_t) {}
+void writePin(uint8_t, bool) {}
+
+// ================== CẢM BIẾN SIÊU ÂM ==================
+void ultrasonicBegin(uint8_t sensor, uint8_t, uint8_t) {
+  if (sensor >= HAL_MAX_DEVICES) return;
+  FakeSensor& s = g_sensors[sensor];
+  s.rng.seed(g_options.seed * 1000003u + sensor);
+  s.car = false;
+  s.pending = false;
+  s.glitchLeft = 0;
+  s.nextChangeMs = millis() + dwellMs(s);
+}
+
+void ultrasonicStart(uint8_t sensor) {
+  g_pings++;
+  if (sensor >= HAL_MAX_DEVICES) return;
+  FakeSensor& s = g_sensors[sensor];
+  uint32_t now = millis();
+  while ((int32_t)(now - s.nextChangeMs) >= 0) { s.car = !s.car; s.nextChangeMs += dwellMs(s); }
+
+  block(10);   // xung trigger HIGH 10µs
+  s.pending = true;
+  s.startUs = nowUs();
+  // Slot trống thỉnh thoảng mất echo (sàn hấp thụ/góc xiên) → HC-SR04 giữ echo ~38ms
+  if (!s.car && uniform(s.rng, 0, 99) < 5) s.echoUs = 38000;
+  else {
+    float cm = s.car ? 3.0f + uniform(s.rng, 0, 50) / 10.0f : 200.0f + uniform(s.rng, 0, 2000) / 10.0f;
+    s.echoUs = (uint32_t)(cm * 2.0f / 0.034f);
+  }
+  // --glitch-pct: người đi ngang slot trống (echo gần như có xe), xe đậu xiên làm mất echo
+  if (g_options.glitchPct && !s.glitchLeft && uniform(s.rng, 0, 99) < g_options.glitchPct)
+    s.glitchLeft = (uint8_t)uniform(s.rng, 1, 3);
+  if (s.glitchLeft) {
+    s.glitchLeft--;
+    s.echoUs = s.car ? 38000 : (uint32_t)((3.0f + uniform(s.rng, 0, 50) / 10.0f) * 2.0f / 0.034f);
+  }
+  s.doneAtUs = s.startUs + 450 + s.echoUs;   // echo lên ~450µs sau trigger
+}
+
+EchoStatus ultrasonicPoll(uint8_t sensor, uint32_t timeoutUs, uint32_t& echoUs) {
+  echoUs = 0;
+  if (sensor >= HAL_MAX_DEVICES || !g_sensors[sensor].pending) return ECHO_IDLE;
+  FakeSensor& s = g_sensors[sensor];
+  uint64_t now = nowUs();
+  // Giống bản ESP32: timeout tính từ trigger
+  if (now < s.doneAtUs && now - s.startUs < timeoutUs) return ECHO_PENDING;
+  s.pending = false;
+  if (now >= s.doneAtUs && s.echoUs <= timeoutUs) echoUs = s.echoUs;
+  if (g_trace) {
+    host::Uncounted uncounted;
+    fprintf(g_trace, "%u,%u,%u,%d\n", millis(), sensor, echoUs, s.car ? 1 : 0);
+  }
+  return ECHO_READY;
+}
+
+// ================== SERVO ==================
+void servoBegin(uint8_t, uint8_t) {}
+void servoWrite(uint8_t, int) {}
+
+// ================== WIFI ==================
+bool wifiConnect(const char*, const char*, uint32_t) { block(300000); return wifiConnected(); }
+bool wifiConnected() {
+  if (g_options.wifiDownEveryS == 0) return true;
+  uint64_t periodUs = g_options.wifiDownEveryS * 1000000ULL;
+  return nowUs() % periodUs < periodUs - g_options.wifiDownForS * 1000000ULL;
+}
+void wifiReconnect() {}
+
+// UDP thật qua socket của máy dev → nhận thử bằng `nc -ulk PORT`
+bool udpSend(const char* host, uint16_t port, const char* data, size_t len) {
+  static int fd = -1;
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) return false;
+  if (fd < 0) fd = socket(AF_INET, SOCK_DGRAM, 0);
+  return fd >= 0 && sendto(fd, data, len, 0, (const sockaddr*)&addr, sizeof(addr)) == (ssize_t)len;
+}
+
+// ================== HTTP ==================
+void httpInit(uint32_t) {}
+
+// Body response của backend giả, đọc theo luồng như socket trên ESP32
+class BodyStream : public Stream {
+public:
+  explicit BodyStream(const std::string& body) : body_(body) {}
+  int available() override { return (int)(body_.size() - pos_); }
+  int read() override { return pos_ < body_.size() ? (unsigned char)body_[pos_++] : -1; }
+  int peek() override { return pos_ < body_.size() ? (unsigned char)body_[pos_] : -1; }
+  size_t readBytes(char* buffer, size_t length) override {
+    size_t n = std::min(length, body_.size() - pos_);
+    memcpy(buffer, body_.data() + pos_, n);
+    pos_ += n;
+    return n;
+  }
+
+private:
+  const std::string& body_;
+  size_t pos_ = 0;
+};
+
+int httpRequest(const HttpRequest& req, HttpBodyReader reader, void* ctx) {
+  g_httpRequests++;
+  if (onMainThread()) g_loopHttpRequests++;
+  block((uint64_t)g_options.httpLatencyMs * 1000);
+  if (!wifiConnected()) { g_connKey.clear(); return -1; }
+
+  // Backend giả (std::string, std::map) là phía server → không tính vào cấp phát của firmware;
+  // chỉ reader (ArduinoJson parse của firmware) được đếm
+  std::string out;
+  int code;
+  {
+    host::Uncounted uncounted;
+    std::string url = req.url;
+    size_t scheme = url.find("://");
+    size_t hostStart = scheme == std::string::npos ? 0 : scheme + 3;
+    size_t pathStart = url.find('/', hostStart);
+    std::string host = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+    std::string path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+
+    // Cùng chính sách với bản ESP32: dùng lại kết nối nếu cùng host và rảnh chưa quá
+    // HAL_HTTP_KEEPALIVE_IDLE_MS (và server chưa tự đóng), ngược lại trả giá handshake
+    g_httpStats.requests++;
+    uint64_t idleUs = nowUs() - g_lastUseUs;
+    bool reused = host == g_connKey && idleUs < HAL_HTTP_KEEPALIVE_IDLE_MS * 1000ULL &&
+                  idleUs < g_options.serverKeepAliveMs * 1000ULL;
+    if (!reused) {
+      block((uint64_t)g_options.tlsHandshakeMs * 1000);
+      g_httpStats.handshakes++;
+      g_httpStats.handshakeMs += g_options.tlsHandshakeMs;
+      g_connKey = host;
+    }
+    code = route(req.method, path, req.body, req.bearer, out);
+  }
+  if (reader) { BodyStream body(out); reader(code, body, ctx); }
+  g_lastUseUs = nowUs();
+  return code;
+}
+
+const char* httpErrorToString(int code) { return code == -1 ? "connection refused" : "transport error"; }
+HttpStats httpStats() { return g_httpStats; }
+
+// ================== TASK + HÀNG ĐỢI ==================
+Queue queueCreate(uint16_t length, uint16_t itemSize) {
+  host::Uncounted uncounted;
+  HostQueue* q = new HostQueue;   // sống tới hết process như xQueue trên board
+  q->length = length; q->itemSize = itemSize;
+  return q;
+}
+
+bool queueSend(Queue queue, const void* item, uint32_t timeoutMs) {
+  host::Uncounted uncounted;   // deque/vector giả lập xQueue (ESP32 copy vào vùng cấp sẵn)
+  HostQueue* q = (HostQueue*)queue;
+  std::unique_lock<std::mutex> lock(g_sched);
+  if (!waitFor(lock, timeoutMs, [q] { return q->items.size() < q->length; })) return false;
+  const uint8_t* bytes = (const uint8_t*)item;
+  q->items.emplace_back(bytes, bytes + q->itemSize);
+  g_schedCv.notify_all();
+  return true;
+}
+
+bool queueReceive(Queue queue, void* item, uint32_t timeoutMs) {
+  host::Uncounted uncounted;
+  HostQueue* q = (HostQueue*)queue;
+  std::unique_lock<std::mutex> lock(g_sched);
+  if (!waitFor(lock, timeoutMs, [q] { return !q->items.empty(); })) return false;
+  memcpy(item, q->items.front().data(), q->itemSize);
+  q->items.pop_front();
+  g_schedCv.notify_all();
+  return true;
+}
+
+bool taskStart(const char*, void (*fn)(void*), void* arg, uint32_t, uint8_t, int) {
+  host::Uncounted uncounted;
+  { std::lock_guard<std::mutex> lock(g_sched); g_runningBackground++; }
+  std::thread(fn, arg).detach();
+  return true;
+}
+
+// ================== FLASH ==================
+uint32_t flashSize() { return (uint32_t)g_flash.size(); }
+
+bool flashRead(uint32_t offset, void* buf, uint32_t len) {
+  if ((uint64_t)offset + len > g_flash.size()) return false;
+  memcpy(buf, g_flash.data() + offset, len);
+  return true;
+}
+
+static void persistFlash(uint32_t offset, uint32_t len) {
+  if (!g_flashFile) return;
+  host::Uncounted uncounted;
+  fseek(g_flashFile, offset, SEEK_SET);
+  fwrite(g_flash.data() + offset, 1, len, g_flashFile);
+  fflush(g_flashFile);
+}
+
+bool flashWrite(uint32_t offset, const void* buf, uint32_t len) {
+  if ((uint64_t)offset + len > g_flash.size()) return false;
+  block(HOST_FLASH_WRITE_US);
+  const uint8_t* src = (const uint8_t*)buf;
+  for (uint32_t i = 0; i < len; i++) g_flash[offset + i] &= src[i];   // NOR: chỉ lật 1→0
+  persistFlash(offset, len);
+  return true;
+}
+
+bool flashEraseSector(uint32_t offset) {
+  if (offset % HAL_FLASH_SECTOR_SIZE || (uint64_t)offset + HAL_FLASH_SECTOR_SIZE > g_flash.size()) return false;
+  block(HOST_FLASH_ERASE_US);
+  g_flashErases++;
+  memset(g_flash.data() + offset, 0xFF, HAL_FLASH_SECTOR_SIZE);
+  persistFlash(offset, HAL_FLASH_SECTOR_SIZE);
+  return true;
+}
+
+// ================== HỆ THỐNG ==================
+uint32_t freeHeap() {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks >= HOST_HEAP_BYTES ? 0 : HOST_HEAP_BYTES - (uint32_t)info.uordblks;
+}
+uint32_t randomSeedValue() { return g_options.seed; }
+const char* deviceId() {
+  static char id[13];
+  snprintf(id, sizeof(id), "0000%08X", g_options.seed);
+  return id;
+}
+
+namespace host {
+void configure(const Options& options) {
+  g_options = options;
+  g_mainThread = std::this_thread::get_id();
+
+  if (options.tracePath) {
+    g_trace = fopen(options.tracePath, "w");
+    if (g_trace) fprintf(g_trace, "ms,slot,echo_us,car\n");
+    else fprintf(stderr, "Không mở được %s\n", options.tracePath);
+  }
+
+  g_flash.assign(options.flashBytes / HAL_FLASH_SECTOR_SIZE * HAL_FLASH_SECTOR_SIZE, 0xFF);
+  if (!options.journalPath) return;
+  // File cũ (cùng cỡ) giữ journal của lần chạy trước, như flash sau khi reset
+  g_flashFile = fopen(options.journalPath, "r+b");
+  if (g_flashFile && fread(g_flash.data(), 1, g_flash.size(), g_flashFile) == g_flash.size()) return;
+  if (g_flashFile) fclose(g_flashFile);
+  std::fill(g_flash.begin(), g_flash.end(), 0xFF);
+  g_flashFile = fopen(options.journalPath, "w+b");
+  if (!g_flashFile) { fprintf(stderr, "Không mở được %s\n", options.journalPath); return; }
+  persistFlash(0, (uint32_t)g_flash.size());
+}
+void advanceUs(uint64_t us) { if (!g_options.realtime) advanceVirtual(us); }
+uint64_t pingCount() { return g_pings; }
+uint64_t httpCount() { return g_httpRequests; }
+uint64_t loopHttpCount() { return g_loopHttpRequests; }
+uint64_t blockedUs() { return g_blockedUs; }
+uint64_t flashErases() { return g_flashErases; }
+uint64_t expiredTokenRejects() { return g_expiredRejects; }
+
+Uncounted::Uncounted() { t_uncounted++; }
+Uncounted::~Uncounted() { t_uncounted--; }
+void startAllocCount() { g_allocCounting = true; }
+uint64_t allocCount() { return g_firmwareAllocs; }
+}  // namespace host
+
+}  // namespace hal
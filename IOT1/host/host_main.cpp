@@ -0,0 +1,126 @@
+// == Entry point cho bản build Linux: setup() rồi loop() mãi như Arduino core ==
+// ./build/parking_host [--seconds N] [--seed N] [--http-latency-ms N] [--tls-handshake-ms N]
+//                      [--server-keepalive-ms N] [--token-ttl S] [--no-slot-event] [--no-bulk-status]
+//                      [--wifi-down-every S --wifi-down-for S] [--journal FILE] [--glitch-pct P]
+//                      [--record-trace FILE] [--realtime] [--quiet] [--bench]
+// --record-trace: ghi mọi lần đo siêu âm kèm trạng thái thật của slot → host/filter_eval (make eval)
+// stdin = Serial RX của board: gõ 's' + Enter → firmware in cả bảng trạng thái
+// --bench: tắt Serial, chạy đủ N giây (thời gian firmware) rồi in thời gian loop() bị chặn
+//          (delay/trigger/HTTP, thời gian firmware) và CPU host, tách riêng các vòng có gọi HTTP,
+//          kèm số lần firmware malloc/new sau setup() (chạy ổn định phải là 0) và số byte in ra Serial
+#include "hal.h"
+#include "hal_host.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+void setup();
+void loop();
+
+struct Samples {
+  std::vector<double> values;
+  void add(double v) { values.push_back(v); }
+  double at(double q) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t idx = (size_t)(q * values.size());
+    return values[std::min(idx, values.size() - 1)];
+  }
+  void print(const char* name, const char* unit) {
+    printf("  %-28s p50=%9.2f  p99=%9.2f  max=%9.2f %s\n", name, at(0.50), at(0.99), at(1.0), unit);
+  }
+};
+
+static void usage(const char* prog) {
+  printf("Usage: %s [--seconds N] [--seed N] [--http-latency-ms N] [--tls-handshake-ms N]\n"
+         "          [--server-keepalive-ms N] [--token-ttl S] [--no-slot-event] [--no-bulk-status]\n"
+         "          [--wifi-down-every S --wifi-down-for S] [--journal FILE] [--glitch-pct P]\n"
+         "          [--record-trace FILE] [--realtime] [--quiet] [--bench]\n", prog);
+}
+
+int main(int argc, char** argv) {
+  hal::host::Options options;
+  uint32_t seconds = 300;
+  bool bench = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(arg, "--seconds") && hasValue) seconds = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(arg, "--seed") && hasValue) options.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--http-latency-ms") && hasValue) options.httpLatencyMs = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(arg, "--tls-handshake-ms") && hasValue) options.tlsHandshakeMs = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(arg, "--server-keepalive-ms") && hasValue) options.serverKeepAliveMs = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(arg, "--token-ttl") && hasValue) options.tokenTtlS = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(arg, "--no-slot-event")) options.slotEventRoute = false;
+    else if (!strcmp(arg, "--no-bulk-status")) options.bulkStatusRoute = false;
+    else if (!strcmp(arg, "--wifi-down-every") && hasValue) options.wifiDownEveryS = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(arg, "--wifi-down-for") && hasValue) options.wifiDownForS = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(arg, "--journal") && hasValue) options.journalPath = argv[++i];
+    else if (!strcmp(arg, "--glitch-pct") && hasValue) options.glitchPct = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(arg, "--record-trace") && hasValue) options.tracePath = argv[++i];
+    else if (!strcmp(arg, "--realtime")) options.realtime = true;
+    else if (!strcmp(arg, "--quiet")) Serial.muted = true;
+    else if (!strcmp(arg, "--bench")) { bench = true; Serial.muted = true; }
+    else { usage(argv[0]); return 1; }
+  }
+  hal::host::configure(options);
+
+  setup();
+  hal::host::startAllocCount();
+
+  // Mỗi lần loop() là một mẫu; lần không bị chặn (không delay/trigger/HTTP) thì đồng hồ ảo nhích 1ms
+  Samples loopStallMs, httpLoopStallMs, loopCpuUs, triggerCpuUs;
+  uint64_t loops = 0, httpLoops = 0;
+  uint32_t startMs = hal::millis();
+  uint64_t serialBytes0 = Serial.bytes;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  while (hal::millis() - startMs < seconds * 1000u) {
+    uint64_t pings0 = hal::host::pingCount(), blocked0 = hal::host::blockedUs(), http0 = hal::host::loopHttpCount();
+    auto t0 = std::chrono::steady_clock::now();
+    loop();
+    auto t1 = std::chrono::steady_clock::now();
+    uint64_t pings = hal::host::pingCount() - pings0;
+    uint64_t blockedUs = hal::host::blockedUs() - blocked0;
+    double cpuUs = std::chrono::duration<double, std::micro>(t1 - t0).count();
+    if (options.realtime) cpuUs -= (double)blockedUs;
+
+    if (bench) {
+      hal::host::Uncounted uncounted;   // mẫu đo của host_main, không phải firmware
+      loops++;
+      if (hal::host::loopHttpCount() > http0) { httpLoops++; httpLoopStallMs.add(blockedUs / 1000.0); }
+      else loopStallMs.add(blockedUs / 1000.0);
+      loopCpuUs.add(cpuUs);
+      if (pings > 0) triggerCpuUs.add(cpuUs / pings);
+    }
+    if (blockedUs == 0) hal::host::advanceUs(1000);
+  }
+
+  if (bench) {
+    uint64_t allocs = hal::host::allocCount();
+    hal::host::Uncounted uncounted;
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+    printf("📊 IOT1 loop latency (%us firmware time, seed=%u, http=%ums)\n", seconds, options.seed, options.httpLatencyMs);
+    printf("  loops=%llu (có HTTP: %llu), triggers=%llu, http=%llu, host wall=%.1fms\n",
+           (unsigned long long)loops, (unsigned long long)httpLoops,
+           (unsigned long long)hal::host::pingCount(), (unsigned long long)hal::host::httpCount(), wallMs);
+    loopStallMs.print("stall/loop (không HTTP)", "ms");
+    httpLoopStallMs.print("stall/loop (có HTTP)", "ms");
+    loopCpuUs.print("host CPU/loop", "µs");
+    triggerCpuUs.print("host CPU/trigger", "µs");
+    hal::HttpStats http = hal::httpStats();
+    printf("  TLS: %u handshake / %u request (tổng %u ms)\n", http.handshakes, http.requests, http.handshakeMs);
+    printf("  flash: %llu lần xoá sector\n", (unsigned long long)hal::host::flashErases());
+    printf("  auth: %llu request bị 401 vì token hết hạn\n", (unsigned long long)hal::host::expiredTokenRejects());
+    uint64_t serialBytes = Serial.bytes - serialBytes0;
+    printf("  serial: %llu byte sau setup() (%.0f byte/s ≈ %.1f%% thời gian UART 115200)\n",
+           (unsigned long long)serialBytes, serialBytes / (double)seconds, serialBytes / (double)seconds / 115.2);
+    printf("  heap: %llu lần malloc/new của firmware sau setup()\n", (unsigned long long)allocs);
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+// == Kiểm tra bảng chân SLOT_LAYOUT=4 (include/slot_config.h) khớp mạch Wokwi (test/diagram.json) ==
+// ./build/pin_check [DIAGRAM.json]   (make check-pins)
+// Mỗi slot i (1..4) của diagram: ultrasonic<i>:TRIG/ECHO, resistor_green<i>:1, resistor_red<i>:1 (LED qua
+// điện trở), servo<i>:PWM phải nối đúng chân "esp32:D<n>" như SLOT_TABLE. Lệch → in từng chỗ, exit 1
+#include "slot_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static_assert(SLOT_LAYOUT == 4, "pin_check chỉ dành cho layout 4 (mạch Wokwi)");
+
+// Mọi chuỗi trong ngoặc kép theo thứ tự xuất hiện (diagram.json không có escape trong tên chân)
+static std::vector<std::string> quotedStrings(const std::string& text) {
+  std::vector<std::string> out;
+  size_t pos = 0;
+  while ((pos = text.find('"', pos)) != std::string::npos) {
+    size_t end = text.find('"', pos + 1);
+    if (end == std::string::npos) break;
+    out.push_back(text.substr(pos + 1, end - pos - 1));
+    pos = end + 1;
+  }
+  return out;
+}
+
+// Chân GPIO nối với endpoint (vd. "ultrasonic1:TRIG"); -1 nếu không có dây "esp32:D<n>" ↔ endpoint
+static int gpioOf(const std::vector<std::string>& s, const std::string& endpoint) {
+  for (size_t i = 0; i + 1 < s.size(); i++) {
+    const std::string* other = nullptr;
+    if (s[i] == endpoint) other = &s[i + 1];
+    else if (s[i + 1] == endpoint) other = &s[i];
+    if (other && other->compare(0, 7, "esp32:D") == 0) return atoi(other->c_str() + 7);
+  }
+  return -1;
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "test/diagram.json";
+  FILE* f = fopen(path, "r");
+  if (!f) { fprintf(stderr, "Không mở được %s\n", path); return 1; }
+  std::string text;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+  fclose(f);
+  std::vector<std::string> strings = quotedStrings(text);
+
+  int mismatches = 0;
+  for (int i = 0; i < NUM_SLOTS; i++) {
+    const SlotPins& p = slotPins(i);
+    std::string id = std::to_string(i + 1);
+    struct { const char* what; std::string endpoint; int expected; } checks[] = {
+      {"trig",  "ultrasonic" + id + ":TRIG",  p.trig},
+      {"echo",  "ultrasonic" + id + ":ECHO",  p.echo},
+      {"ledG",  "resistor_green" + id + ":1", p.ledGreen},
+      {"ledR",  "resistor_red" + id + ":1",   p.ledRed},
+      {"servo", "servo" + id + ":PWM",        p.servo},
+    };
+    for (const auto& c : checks) {
+      int actual = gpioOf(strings, c.endpoint);
+      if (actual == c.expected) continue;
+      printf("❌ Slot %d %s: SLOT_TABLE = %d, %s nối D%d\n", i + 1, c.what, c.expected, c.endpoint.c_str(), actual);
+      mismatches++;
+    }
+  }
+  if (mismatches) return 1;
+  printf("✅ SLOT_TABLE (4 slot) khớp %s\n", path);
+  return 0;
+}
@@ -0,0 +1,128 @@
+// == HAL: lớp mỏng giữa logic bãi xe và phần cứng/mạng ==
+// - ESP32:  src/hal_esp32.cpp (Arduino core, ESP32Servo, WiFi, HTTPClient + TLS)
+// - Linux:  host/hal_linux.cpp (cảm biến giả lập, backend HTTP giả trong process)
+// Logic trong main.cpp chỉ gọi hal::*, nên cùng một code chạy được trên board,
+// Wokwi và máy dev (unit test, perf, valgrind, benchmark loop latency).
+#pragma once
+
+#include <Arduino.h>   // Stream, Serial (Linux: host/Arduino.h)
+#include <stdint.h>
+
+#define HAL_MAX_DEVICES 64   // số cảm biến/servo tối đa theo chỉ số slot
+
+// Số chân dùng chung cho GPIO thật và chân mở rộng (board nhiều slot, xem include/slot_config.h):
+//   0..39     GPIO của ESP32
+//   40..167   MCP23017 trên I2C: chip n/16 (địa chỉ 0x20 + n/16), chân n%16 → LED, trigger
+//   168..231  cặp 74HC4067 (trigger + echo) của bank b, kênh c → cảm biến siêu âm
+#define HAL_NO_PIN          0xFF   // slot không có thiết bị này (vd. không có servo)
+#define HAL_EXP_PIN_BASE    40
+#define HAL_EXP_CHIPS       8
+#define HAL_MUX_PIN_BASE    (HAL_EXP_PIN_BASE + HAL_EXP_CHIPS * 16)
+#define HAL_MUX_BANKS       4
+#define HAL_MUX_CHANNELS    16
+#define HAL_EXP_PIN(n)      ((uint8_t)(HAL_EXP_PIN_BASE + (n)))
+#define HAL_MUX_PIN(b, c)   ((uint8_t)(HAL_MUX_PIN_BASE + (b) * HAL_MUX_CHANNELS + (c)))
+#define HAL_IS_EXP_PIN(p)   ((p) >= HAL_EXP_PIN_BASE && (p) < HAL_MUX_PIN_BASE)
+#define HAL_IS_MUX_PIN(p)   ((p) >= HAL_MUX_PIN_BASE && (p) < HAL_MUX_PIN_BASE + HAL_MUX_BANKS * HAL_MUX_CHANNELS)
+
+namespace hal {
+
+// ================== THỜI GIAN ==================
+uint32_t millis();
+uint32_t micros();
+void delayMs(uint32_t ms);
+void delayUs(uint32_t us);
+// Bộ đếm chu kỳ CPU của core đang chạy (ESP32: CCOUNT, tràn sau ~17s ở 240MHz) → đo span ngắn
+// rẻ hơn micros(). Đầu và cuối span phải trên cùng core (task đã ghim core)
+uint32_t cycles();
+uint32_t cyclesPerUs();
+
+// ================== GPIO ==================
+void pinOutput(uint8_t pin);
+void pinInput(uint8_t pin);
+void writePin(uint8_t pin, bool high);
+
+// ================== CẢM BIẾN SIÊU ÂM (HC-SR04) ==================
+// Không chặn: ultrasonicStart chỉ phát xung trigger (~12µs), cạnh lên/xuống của echo
+// được bắt bằng ngắt GPIO; ultrasonicPoll lấy kết quả khi đã xong
+enum EchoStatus : uint8_t { ECHO_IDLE, ECHO_PENDING, ECHO_READY };
+
+// Cảm biến qua mux: trigPin = echoPin = HAL_MUX_PIN(b, c). Chân chọn kênh dùng chung mọi bank
+// → các cảm biến mux đang đo cùng lúc phải cùng kênh (mỗi bank tối đa một cái)
+void ultrasonicBegin(uint8_t sensor, uint8_t trigPin, uint8_t echoPin);
+void ultrasonicStart(uint8_t sensor);
+// ECHO_READY trả độ rộng xung echo (µs, 0 = không có echo trong timeoutUs) đúng một lần rồi về ECHO_IDLE
+EchoStatus ultrasonicPoll(uint8_t sensor, uint32_t timeoutUs, uint32_t& echoUs);
+
+// ================== SERVO ==================
+void servoBegin(uint8_t servo, uint8_t pin);   // HAL_NO_PIN → servoWrite không làm gì
+void servoWrite(uint8_t servo, int angle);
+
+// ================== WIFI ==================
+bool wifiConnect(const char* ssid, const char* pass, uint32_t timeoutMs);
+bool wifiConnected();
+void wifiReconnect();
+// Gửi một gói UDP (telemetry). host phải là IP dạng chuỗi: không tra DNS → không chặn nơi gọi
+bool udpSend(const char* host, uint16_t port, const char* data, size_t len);
+
+// ================== HTTP ==================
+// extraHeaders: mảng {name, value, name, value, ..., nullptr} (có thể nullptr).
+// Chuỗi do nơi gọi giữ (vd. scratch arena) tới khi httpRequest trả về
+struct HttpRequest {
+  const char* method;
+  const char* url;
+  const char* body;            // "" → không gửi body/Content-Type
+  const char* bearer;          // "" → không gửi Authorization
+  const char* const* extraHeaders;
+};
+
+// Một kết nối HTTP/1.1 keep-alive dùng chung cho mọi request (body chunked được ghép lại).
+// Kết nối rảnh quá HAL_HTTP_KEEPALIVE_IDLE_MS thì mở lại chủ động, trước khi server đóng
+// (Node mặc định keepAliveTimeout = 5s) → không gửi request vào socket đã chết
+#define HAL_HTTP_KEEPALIVE_IDLE_MS 4000
+
+struct HttpStats {
+  uint32_t requests;
+  uint32_t handshakes;    // số kết nối mới (TCP + TLS handshake)
+  uint32_t handshakeMs;   // tổng thời gian handshake
+};
+
+// Đọc body theo luồng: reader được gọi một lần khi có status (> 0), body đã bỏ chunked và dừng
+// đúng cuối response → ArduinoJson parse thẳng từ socket, không ghép cả body vào String.
+// Phần reader không đọc hết được HAL xả bỏ để giữ kết nối keep-alive
+typedef void (*HttpBodyReader)(int code, Stream& body, void* ctx);
+
+void httpInit(uint32_t timeoutMs);
+// Trả HTTP status (> 0) hoặc mã lỗi transport (<= 0)
+int httpRequest(const HttpRequest& req, HttpBodyReader reader, void* ctx);
+const char* httpErrorToString(int code);
+HttpStats httpStats();
+
+// ================== TASK + HÀNG ĐỢI ==================
+// ESP32: FreeRTOS task ghim core + xQueue; Linux: std::thread + hàng đợi mutex/condvar.
+// Phần tử được copy theo byte như xQueueSend → chỉ dùng struct POD (không String)
+typedef void* Queue;
+const uint32_t WAIT_FOREVER = 0xFFFFFFFFu;
+
+Queue queueCreate(uint16_t length, uint16_t itemSize);
+bool queueSend(Queue queue, const void* item, uint32_t timeoutMs);     // false: đầy quá timeoutMs
+bool queueReceive(Queue queue, void* item, uint32_t timeoutMs);        // false: rỗng quá timeoutMs
+bool taskStart(const char* name, void (*fn)(void*), void* arg, uint32_t stackBytes, uint8_t priority, int core);
+
+// ================== FLASH (journal sự kiện) ==================
+// Vùng flash thô cho journal, hành xử như NOR flash: ghi chỉ lật bit 1→0, muốn ghi lại
+// phải xoá cả sector về 0xFF. ESP32: phân vùng "journal" (partitions.csv), thiếu thì dùng
+// tạm RAM (mất khi reset); Linux: file (--journal PATH) hoặc RAM
+#define HAL_FLASH_SECTOR_SIZE 4096
+
+uint32_t flashSize();                                                 // 0 = không có vùng nào
+bool flashRead(uint32_t offset, void* buf, uint32_t len);
+bool flashWrite(uint32_t offset, const void* buf, uint32_t len);
+bool flashEraseSector(uint32_t offset);                               // offset chia hết cho sector
+
+// ================== HỆ THỐNG ==================
+uint32_t freeHeap();
+uint32_t randomSeedValue();
+const char* deviceId();   // định danh node (MAC) → idempotency key của sự kiện
+
+}  // namespace hal
@@ -0,0 +1,25 @@
+// == Journal sự kiện: ring buffer bản ghi cố định trên flash (hal::flash*) ==
+// - Ghi nối tiếp vòng quanh vùng flash → mỗi sector chỉ bị xoá một lần mỗi vòng (mòn đều);
+//   64KB / 64B = 1024 bản ghi mỗi vòng, ~100k chu kỳ xoá → ~10^8 sự kiện
+// - Đánh dấu đã gửi bằng cách ghi đè word "consumed" 0xFFFFFFFF → 0 (không cần xoá)
+// - Khởi động: quét toàn vùng, bản ghi hỏng CRC (mất điện giữa lúc ghi) bị bỏ qua
+// Không thread-safe: chỉ network task gọi
+#pragma once
+
+#include <stdint.h>
+
+#define JOURNAL_RECORD_SIZE  64
+#define JOURNAL_PAYLOAD_SIZE 48
+
+namespace journal {
+
+bool begin();                                                   // false: không có flash
+// seq tăng dần qua các lần khởi động → dùng làm idempotency key cùng deviceId
+bool append(const void* payload, uint8_t len, uint32_t& outSeq); // false: đầy hoặc lỗi flash
+bool peek(void* payload, uint8_t& len, uint32_t& outSeq);        // bản ghi cũ nhất chưa gửi
+bool pop();                                                     // đánh dấu bản ghi cũ nhất đã gửi
+uint32_t pending();
+uint32_t capacity();
+uint32_t nextSeq();   // seq < giá trị lúc begin() → bản ghi từ lần khởi động trước
+
+}  // namespace journal
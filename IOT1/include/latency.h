@@ -0,0 +1,78 @@
+// == Độ trễ theo giai đoạn: span đếm chu kỳ CPU → histogram bucket log2 cố định ==
+// - Span = 2 lần đọc hal::cycles() + 1 lần ghi bucket (không heap, không khoá, không Serial)
+// - Bucket k chứa [2^k, 2^(k+1)) µs (bucket 0: < 2µs, bucket cuối: ≥ 2^(LATENCY_BUCKETS-1) µs)
+// - Số đếm cộng dồn từ lúc khởi động; nơi thu lấy hiệu 2 frame → mất gói UDP không sai số liệu
+// Mỗi stage chỉ một task ghi (loop() hoặc network task, xem Stage); đọc từ task khác qua
+// snapshot() (seqlock) → không bao giờ thấy histogram ghi dở
+#pragma once
+
+#include "hal.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LATENCY_BUCKETS 26     // bucket cuối ≥ 2^25 µs ≈ 33s (quá HTTP timeout 20s)
+#define LATENCY_FRAME_BYTES 1400   // vừa một gói UDP không phân mảnh
+
+namespace latency {
+
+enum Stage : uint8_t {
+  // loop() (core 1)
+  RANGE,      // trigger → echo cuối của một lượt đo
+  FILTER,     // updateSlotStatus: gom mẫu + SlotFilter::step
+  REACT,      // updateSlotStatus: xử lý một slot đổi trạng thái (biển số, hàng đợi, LED, log)
+  GATE,       // phát hiện xe vào → servo mở
+  // network task (core 0): mỗi hàm HTTP, gồm cả retry và login lại khi 401
+  LOGIN,
+  PLATE,      // GET biển số (cache hit cũng tính)
+  CHECKIN,
+  CHECKOUT,
+  EVENT,      // slot event
+  STATUS,     // PUT trạng thái slot (từng cái hoặc lô)
+  ARRIVAL,    // phát hiện xe vào → server nhận check-in (gồm hàng đợi, journal, mất mạng)
+  STAGE_COUNT
+};
+
+struct Histogram {
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t sumUs;
+  uint32_t buckets[LATENCY_BUCKETS];
+};
+
+// Điểm bắt đầu span: chu kỳ cho độ phân giải, millis() cho span dài hơn vòng tràn CCOUNT
+struct Mark {
+  uint32_t cycles;
+  uint32_t ms;
+};
+inline Mark mark() { return {hal::cycles(), hal::millis()}; }
+uint32_t elapsedUs(const Mark& from);
+
+void record(Stage stage, uint32_t us);
+inline void recordSince(Stage stage, const Mark& from) { record(stage, elapsedUs(from)); }
+// Span đo bằng millis() ở nơi khác (vd. NetJob::eventMs từ core kia)
+inline void recordMs(Stage stage, uint32_t ms) { record(stage, ms < 0xFFFFFFFFu / 1000 ? ms * 1000 : 0xFFFFFFFFu); }
+
+void snapshot(Stage stage, Histogram& out);
+uint32_t percentileUs(const Histogram& h, uint32_t permille);   // cận trên của bucket chứa phân vị
+const char* stageName(Stage stage);
+
+// Frame 1 dòng cho máy đọc (Serial / UDP), mọi stage có số liệu:
+//   @lat 1 <uptime_ms> <stage>:<count>:<sum_us>:<max_us>:<k>=<n>,<k>=<n>... ...
+// (chỉ bucket khác 0). Trả độ dài; thiếu chỗ thì bỏ các stage cuối
+size_t frame(char* out, size_t cap);
+
+}  // namespace latency
+
+// Span theo scope: ghi độ trễ của stage lúc ra khỏi scope (mọi nhánh return)
+class LatencySpan {
+public:
+  explicit LatencySpan(latency::Stage stage) : stage_(stage), from_(latency::mark()) {}
+  ~LatencySpan() { latency::recordSince(stage_, from_); }
+  LatencySpan(const LatencySpan&) = delete;
+  LatencySpan& operator=(const LatencySpan&) = delete;
+
+private:
+  latency::Stage stage_;
+  latency::Mark from_;
+};
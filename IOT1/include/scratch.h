@@ -0,0 +1,40 @@
+// == Scratch arena: bộ nhớ tạm của một request (URL, body, JSON document) ==
+// - Một vùng tĩnh SCRATCH_BYTES, cấp phát kiểu bump (con trỏ chỉ tăng, căn 8 byte)
+// - ScratchScope nhớ vị trí lúc vào và trả hết lúc ra → mỗi request dùng lại cùng vùng nhớ,
+//   không đụng heap. Scope lồng nhau được (401 → login ngay giữa một request khác)
+// - Hết chỗ thì trả nullptr, không rơi về malloc: ArduinoJson báo NoMemory, failures() tăng
+// Không thread-safe: chỉ network task dùng (và testAPI() trước khi task chạy)
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef SCRATCH_BYTES
+#define SCRATCH_BYTES 12288   // 3 document (body, filter, response) × 2 khi login lồng trong request
+#endif
+
+namespace scratch {
+
+void* alloc(size_t bytes);                 // nullptr: hết chỗ
+// Chuỗi format trong arena; "" nếu hết chỗ
+const char* format(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+size_t mark();
+void rewind(size_t mark);                  // trả mọi thứ cấp sau mark()
+size_t peak();                             // byte dùng nhiều nhất từ lúc khởi động
+uint32_t failures();                       // số lần hết chỗ
+ArduinoJson::Allocator* json();            // JsonDocument doc(scratch::json())
+
+}  // namespace scratch
+
+// Document và chuỗi tạo trong scope phải hết dùng trước khi scope đóng (khai báo scope trước)
+class ScratchScope {
+public:
+  ScratchScope() : mark_(scratch::mark()) {}
+  ~ScratchScope() { scratch::rewind(mark_); }
+  ScratchScope(const ScratchScope&) = delete;
+  ScratchScope& operator=(const ScratchScope&) = delete;
+
+private:
+  size_t mark_;
+};
@@ -0,0 +1,56 @@
+// == Cấu hình slot lúc compile: bảng chân cắm → NUM_SLOTS, không có code riêng cho từng slot ==
+// Chọn bằng SLOT_LAYOUT (platformio.ini build_flags / make SLOT_LAYOUT=16):
+//  4  : 4 slot nối thẳng GPIO, đúng mạch Wokwi test/diagram.json (mặc định; make check-pins đối chiếu)
+//  16 : 1 bank mux cảm biến, LED qua 2 MCP23017, không servo
+//  64 : 4 bank mux (đo 4 cảm biến cùng lúc, mỗi bank một cái), LED qua 8 MCP23017, không servo
+// Bảng là constexpr → nằm trong flash, chỉ đọc lúc init và khi đổi LED/servo.
+// Trạng thái chạy mỗi vòng (khoảng cách, state, ...) nằm riêng trong slots[] của main.cpp
+#pragma once
+
+#include "hal.h"
+
+#ifndef SLOT_LAYOUT
+#define SLOT_LAYOUT 4
+#endif
+
+struct SlotPins {
+  uint8_t trig, echo, ledGreen, ledRed, servo;
+};
+
+template <int N> struct SlotTable {
+  SlotPins pins[N];
+};
+
+// Slot i: cảm biến ở bank i/16 kênh i%16; LED xanh/đỏ là 2 chân expander liền nhau.
+// Lượt đo bắn slot g, g+16, g+32, ... → cùng kênh, khác bank (đúng ràng buộc của hal.h)
+template <int N> constexpr SlotTable<N> muxLayout() {
+  static_assert(N % HAL_MUX_CHANNELS == 0 && N <= HAL_MUX_BANKS * HAL_MUX_CHANNELS, "hết bank mux");
+  static_assert(2 * N <= HAL_EXP_CHIPS * 16, "hết chân expander cho LED");
+  SlotTable<N> t = {};
+  for (int i = 0; i < N; i++) {
+    uint8_t sensor = HAL_MUX_PIN(i / HAL_MUX_CHANNELS, i % HAL_MUX_CHANNELS);
+    t.pins[i] = {sensor, sensor, HAL_EXP_PIN(2 * i), HAL_EXP_PIN(2 * i + 1), HAL_NO_PIN};
+  }
+  return t;
+}
+
+#if SLOT_LAYOUT == 4
+constexpr SlotTable<4> SLOT_TABLE = {{
+  // trig echo ledG ledR servo
+  {4, 2, 5, 18, 15},
+  {19, 21, 23, 22, 13},
+  {25, 26, 14, 27, 12},
+  {32, 33, 0, 17, 16},
+}};
+constexpr int SLOT_RANGING_CONCURRENCY = 2;   // cảm biến cách xa nhau, bắn 2 cái một lượt
+#elif SLOT_LAYOUT == 16 || SLOT_LAYOUT == 64
+constexpr SlotTable<SLOT_LAYOUT> SLOT_TABLE = muxLayout<SLOT_LAYOUT>();
+constexpr int SLOT_RANGING_CONCURRENCY = SLOT_LAYOUT / HAL_MUX_CHANNELS;   // mỗi bank một cảm biến
+#else
+#error "SLOT_LAYOUT phải là 4, 16 hoặc 64"
+#endif
+
+constexpr int NUM_SLOTS = sizeof(SLOT_TABLE.pins) / sizeof(SLOT_TABLE.pins[0]);
+static_assert(NUM_SLOTS <= HAL_MAX_DEVICES, "HAL_MAX_DEVICES nhỏ hơn số slot");
+
+inline const SlotPins& slotPins(int i) { return SLOT_TABLE.pins[i]; }
@@ -0,0 +1,103 @@
+// == Bộ lọc khoảng cách → có xe/trống, chạy cho cả bãi một lượt ==
+// Mỗi slot: median FILTER_WINDOW mẫu gần nhất (bỏ echo lạc lẻ tẻ) → EMA trên khoảng cách đã kẹp
+// ở clampCm (xa hơn đều là "trống", 400cm không kéo EMA chậm lại) → điểm tin cậy: mẫu nằm phía
+// bên kia ngưỡng hysteresis +1, mẫu khác -1 (về 0); đủ confirm điểm mới đổi trạng thái.
+// Dữ liệu xếp theo cột (SoA), không rẽ nhánh theo slot → compiler vector hoá vòng lặp qua các slot.
+// Dùng chung cho firmware (main.cpp) và host/filter_eval.cpp (đánh giá trên trace đã ghi)
+#pragma once
+
+#include <stdint.h>
+
+#ifndef FILTER_WINDOW
+#define FILTER_WINDOW 7   // lẻ; loạt nhiễu ngắn hơn nửa cửa sổ (≤ 3 mẫu) không qua được median
+#endif
+static_assert(FILTER_WINDOW % 2 == 1, "FILTER_WINDOW phải lẻ");
+
+struct FilterParams {
+  float   occupyCm = 10.0f;   // EMA dưới ngưỡng này → phía "có xe"
+  float   freeCm   = 14.0f;   // EMA trên ngưỡng này → phía "trống" (giữa 2 ngưỡng: giữ nguyên)
+  float   clampCm  = 30.0f;
+  float   alpha    = 0.5f;    // trọng số mẫu mới của EMA
+  int32_t confirm  = 2;       // số mẫu liên tiếp (gần đúng) ủng hộ trạng thái mới
+};
+
+// Độ rộng xung echo (µs) → cm; 0 (không có echo) hoặc ngoài tầm HC-SR04 → 400
+inline float echoToCM(uint32_t echoUs) {
+  float distance = echoUs * 0.034f / 2.0f;
+  if (distance <= 0 || distance > 400) distance = 400;
+  return distance;
+}
+
+// Bên trong tính bằng số nguyên (mm, EMA Q8): so sánh float mặc định (-ftrapping-math) chặn
+// if-conversion nên không vector hoá được, so sánh int thì được; độ phân giải 1mm là thừa
+namespace filter_detail {
+inline int32_t imin(int32_t a, int32_t b) { return a < b ? a : b; }
+inline int32_t imax(int32_t a, int32_t b) { return a > b ? a : b; }
+// Sắp bằng odd-even transposition (W vòng min/max cố định, không nhánh) rồi lấy phần tử giữa
+// (unroll hết → thân vòng lặp theo slot phẳng, vectorizer mới nhận)
+inline int32_t median(int32_t (&v)[FILTER_WINDOW]) {
+#pragma GCC unroll 16
+  for (int round = 0; round < FILTER_WINDOW; round++)
+#pragma GCC unroll 16
+    for (int j = round & 1; j + 1 < FILTER_WINDOW; j += 2) {
+      int32_t lo = imin(v[j], v[j + 1]), hi = imax(v[j], v[j + 1]);
+      v[j] = lo; v[j + 1] = hi;
+    }
+  return v[FILTER_WINDOW / 2];
+}
+}  // namespace filter_detail
+
+inline int32_t cmToMm(float cm) { return (int32_t)(cm * 10.0f + 0.5f); }
+
+template <int N> struct SlotFilter {
+  int32_t window[FILTER_WINDOW][N];   // mm, window[0] = mẫu mới nhất
+  int32_t emaQ8[N];                   // mm × 256
+  int32_t score[N];
+  int32_t occupied[N];                // 0/1
+  int32_t changed[N];                 // 1: step() vừa đổi trạng thái slot này
+
+  void reset(const FilterParams& p) {
+    int32_t clampMm = cmToMm(p.clampCm);
+    for (int i = 0; i < N; i++) {
+      for (int k = 0; k < FILTER_WINDOW; k++) window[k][i] = clampMm;
+      emaQ8[i] = clampMm * 256; score[i] = 0; occupied[i] = 0; changed[i] = 0;
+    }
+  }
+
+  float emaCm(int i) const { return emaQ8[i] / 2560.0f; }
+
+  // sampleMm[i]: khoảng cách mới (cmToMm); fresh[i] != 0 nếu slot i có mẫu mới (slot khác giữ nguyên).
+  // Mọi giá trị đọc vô điều kiện rồi chọn bằng ?: → GCC -O2 vector hoá được (__restrict: khỏi
+  // kiểm tra chồng vùng nhớ lúc chạy)
+  void step(const int32_t* __restrict sampleMm, const int32_t* __restrict fresh, const FilterParams& p) {
+    using namespace filter_detail;
+    const int32_t clampMm = cmToMm(p.clampCm), alphaQ8 = (int32_t)(p.alpha * 256.0f + 0.5f);
+    const int32_t occupyQ8 = cmToMm(p.occupyCm) * 256, freeQ8 = cmToMm(p.freeCm) * 256;
+    const int32_t confirm = p.confirm;
+    for (int i = 0; i < N; i++) {
+      int32_t f = fresh[i] != 0;
+      int32_t x = imin(sampleMm[i], clampMm);
+      int32_t v[FILTER_WINDOW];
+#pragma GCC unroll 16
+      for (int k = 0; k < FILTER_WINDOW; k++) v[k] = window[k][i];
+#pragma GCC unroll 16
+      for (int k = FILTER_WINDOW - 1; k > 0; k--) v[k] = f ? v[k - 1] : v[k];   // có mẫu mới → dịch cửa sổ
+      v[0] = f ? x : v[0];
+#pragma GCC unroll 16
+      for (int k = 0; k < FILTER_WINDOW; k++) window[k][i] = v[k];
+
+      int32_t m = median(v);
+      int32_t prev = emaQ8[i];
+      int32_t e = f ? prev + ((alphaQ8 * (m * 256 - prev)) >> 8) : prev;
+      emaQ8[i] = e;
+
+      int32_t occ = occupied[i], sc = score[i];
+      int32_t against = occ ? e > freeQ8 : e < occupyQ8;
+      int32_t s = against ? sc + 1 : imax(sc - 1, 0);
+      int32_t flip = f & (s >= confirm);
+      score[i] = f ? (flip ? 0 : s) : sc;
+      occupied[i] = occ ^ flip;
+      changed[i] = flip;
+    }
+  }
+};
@@ -0,0 +1,431 @@
+// == HAL cho ESP32 (Arduino core) ==
+// Build bởi PlatformIO; bản Linux nằm ở host/hal_linux.cpp
+#include "hal.h"
+
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <WiFiUdp.h>
+#include <HTTPClient.h>
+#include <ESP32Servo.h>
+#include <Wire.h>
+#include <soc/gpio_struct.h>
+#include <esp_partition.h>
+
+// Trạng thái bắt echo của từng cảm biến; ISR ghi, ultrasonicPoll đọc
+struct EchoCapture {
+  volatile uint32_t startUs;   // lúc phát trigger
+  volatile uint32_t riseUs;
+  volatile uint32_t widthUs;
+  volatile uint8_t  phase;     // ECHO_PHASE_*
+};
+enum { ECHO_PHASE_IDLE, ECHO_PHASE_ARMED, ECHO_PHASE_HIGH, ECHO_PHASE_DONE };
+
+static uint8_t g_trigPins[HAL_MAX_DEVICES];   // GPIO hoặc chân expander
+static uint8_t g_echoPins[HAL_MAX_DEVICES];   // GPIO thật (chân chung của bank nếu qua mux)
+static uint8_t g_sensorMux[HAL_MAX_DEVICES];  // HAL_MUX_PIN của cảm biến, HAL_NO_PIN = nối thẳng
+static EchoCapture g_echo[HAL_MAX_DEVICES];
+static Servo g_servos[HAL_MAX_DEVICES];
+static WiFiClientSecure g_tlsClient;   // kết nối keep-alive dùng chung (chỉ network task gọi HTTP)
+static uint32_t g_httpTimeoutMs = 20000;
+static char g_connKey[72];             // "host:port" của kết nối đang mở
+static uint32_t g_lastUseMs = 0;
+static hal::HttpStats g_httpStats = {};
+static const esp_partition_t* g_journalPart = nullptr;
+static uint8_t* g_ramFlash = nullptr;   // khi bảng phân vùng không có "journal" (vd. Wokwi)
+static const uint32_t RAM_FLASH_BYTES = 4 * HAL_FLASH_SECTOR_SIZE;
+
+// ================== GPIO EXPANDER + MUX ==================
+// Chỉ board nhiều slot dùng (include/slot_config.h); layout 4 slot không đụng I2C/mux nên các
+// chân dưới đây vẫn dùng được cho cảm biến/LED nối thẳng.
+// MCP23017 (BANK=0): IODIR A/B = 0x00/0x01, OLAT A/B = 0x14/0x15; giữ bản sao để khỏi đọc lại qua I2C
+static const uint8_t  EXP_I2C_SDA = 21, EXP_I2C_SCL = 22;
+static const uint32_t EXP_I2C_HZ  = 400000;
+static const uint8_t  MCP_IODIRA = 0x00, MCP_OLATA = 0x14;
+static uint16_t g_expDir[HAL_EXP_CHIPS] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF};   // reset: input
+static uint16_t g_expOut[HAL_EXP_CHIPS];
+static bool g_wireReady = false;
+
+// Mỗi bank: 2 con 74HC4067 (trigger, echo), 4 chân chọn kênh S0..S3 chung cho mọi bank.
+// Echo ở GPIO 32..35 (34/35 chỉ input) để ISR đọc thẳng thanh ghi
+struct MuxBank { uint8_t trig, echo; };
+static const uint8_t MUX_SELECT_PINS[4] = {25, 26, 27, 14};
+static const MuxBank MUX_BANKS[HAL_MUX_BANKS] = {{4, 34}, {16, 35}, {17, 32}, {18, 33}};
+static const uintptr_t ISR_BANK = 0x100;
+static volatile uint8_t g_bankSensor[HAL_MUX_BANKS];   // cảm biến đang đo của mỗi bank (ISR đọc)
+static uint8_t g_banksReady = 0;
+
+// Ghi nửa port (A: chân 0-7, B: chân 8-15) chứa chân n của bản sao
+static void expSync(const uint16_t* shadow, uint8_t regA, uint8_t n) {
+  if (!g_wireReady) { Wire.begin(EXP_I2C_SDA, EXP_I2C_SCL, EXP_I2C_HZ); g_wireReady = true; }
+  uint8_t chip = n / 16, port = (n % 16) / 8;
+  Wire.beginTransmission(0x20 + chip);
+  Wire.write(regA + port);
+  Wire.write((uint8_t)(shadow[chip] >> (8 * port)));
+  Wire.endTransmission();
+}
+
+static void expSetDirection(uint8_t n, bool output) {
+  uint16_t bit = 1u << (n % 16);
+  if (output) g_expDir[n / 16] &= ~bit; else g_expDir[n / 16] |= bit;
+  expSync(g_expDir, MCP_IODIRA, n);
+}
+
+static void expWrite(uint8_t n, bool high) {
+  uint16_t bit = 1u << (n % 16);
+  uint16_t before = g_expOut[n / 16];
+  if (high) g_expOut[n / 16] |= bit; else g_expOut[n / 16] &= ~bit;
+  if (g_expOut[n / 16] != before) expSync(g_expOut, MCP_OLATA, n);   // LED không đổi → không tốn I2C
+}
+
+namespace hal {
+
+// ================== THỜI GIAN ==================
+uint32_t millis() { return ::millis(); }
+uint32_t micros() { return ::micros(); }
+void delayMs(uint32_t ms) { ::delay(ms); }
+void delayUs(uint32_t us) { ::delayMicroseconds(us); }
+uint32_t cycles() { return ESP.getCycleCount(); }
+uint32_t cyclesPerUs() { return ESP.getCpuFreqMHz(); }
+
+// ================== GPIO ==================
+void pinOutput(uint8_t pin) {
+  if (HAL_IS_EXP_PIN(pin)) expSetDirection(pin - HAL_EXP_PIN_BASE, true);
+  else if (pin < HAL_EXP_PIN_BASE) pinMode(pin, OUTPUT);
+}
+void pinInput(uint8_t pin) {
+  if (HAL_IS_EXP_PIN(pin)) expSetDirection(pin - HAL_EXP_PIN_BASE, false);
+  else if (pin < HAL_EXP_PIN_BASE) pinMode(pin, INPUT);
+}
+void writePin(uint8_t pin, bool high) {
+  if (HAL_IS_EXP_PIN(pin)) expWrite(pin - HAL_EXP_PIN_BASE, high);
+  else if (pin < HAL_EXP_PIN_BASE) digitalWrite(pin, high ? HIGH : LOW);
+}
+
+// ================== CẢM BIẾN SIÊU ÂM ==================
+// Đọc thẳng thanh ghi GPIO: chạy được trong ISR (IRAM), không qua digitalRead
+static inline bool IRAM_ATTR echoLevel(uint8_t pin) {
+  return pin < 32 ? (GPIO.in >> pin) & 1 : (GPIO.in1.val >> (pin - 32)) & 1;
+}
+
+// arg: chỉ số cảm biến, hoặc ISR_BANK | bank → cảm biến đang đo trên bank đó
+static void IRAM_ATTR echoIsr(void* arg) {
+  uintptr_t line = (uintptr_t)arg;
+  uint8_t sensor = (line & ISR_BANK) ? g_bankSensor[line & ~ISR_BANK] : (uint8_t)line;
+  EchoCapture& c = g_echo[sensor];
+  uint32_t now = ::micros();
+  if (echoLevel(g_echoPins[sensor])) {
+    if (c.phase == ECHO_PHASE_ARMED) { c.riseUs = now; c.phase = ECHO_PHASE_HIGH; }
+  } else if (c.phase == ECHO_PHASE_HIGH) {
+    c.widthUs = now - c.riseUs; c.phase = ECHO_PHASE_DONE;
+  }
+}
+
+static void muxBankBegin(uint8_t bank) {
+  if (g_banksReady & (1u << bank)) return;
+  if (!g_banksReady) for (uint8_t pin : MUX_SELECT_PINS) { pinMode(pin, OUTPUT); digitalWrite(pin, LOW); }
+  g_banksReady |= 1u << bank;
+  pinMode(MUX_BANKS[bank].trig, OUTPUT); digitalWrite(MUX_BANKS[bank].trig, LOW);
+  pinMode(MUX_BANKS[bank].echo, INPUT);
+  attachInterruptArg(digitalPinToInterrupt(MUX_BANKS[bank].echo), echoIsr,
+                     (void*)(ISR_BANK | bank), CHANGE);
+}
+
+void ultrasonicBegin(uint8_t sensor, uint8_t trigPin, uint8_t echoPin) {
+  if (sensor >= HAL_MAX_DEVICES) return;
+  g_echo[sensor].phase = ECHO_PHASE_IDLE;
+  if (HAL_IS_MUX_PIN(echoPin)) {
+    uint8_t bank = (echoPin - HAL_MUX_PIN_BASE) / HAL_MUX_CHANNELS;
+    g_sensorMux[sensor] = echoPin;
+    g_trigPins[sensor] = MUX_BANKS[bank].trig; g_echoPins[sensor] = MUX_BANKS[bank].echo;
+    muxBankBegin(bank);
+    return;
+  }
+  g_sensorMux[sensor] = HAL_NO_PIN;
+  g_trigPins[sensor] = trigPin; g_echoPins[sensor] = echoPin;
+  hal::pinOutput(trigPin); hal::writePin(trigPin, false);
+  pinMode(echoPin, INPUT);
+  attachInterruptArg(digitalPinToInterrupt(echoPin), echoIsr, (void*)(uintptr_t)sensor, CHANGE);
+}
+
+void ultrasonicStart(uint8_t sensor) {
+  if (sensor >= HAL_MAX_DEVICES) return;
+  EchoCapture& c = g_echo[sensor];
+  uint8_t trig = g_trigPins[sensor];
+  uint8_t mux = g_sensorMux[sensor];
+  if (mux != HAL_NO_PIN) {
+    // Chọn kênh trước khi arm: trigger và echo của bank cùng nối vào cảm biến này
+    uint8_t ch = (mux - HAL_MUX_PIN_BASE) % HAL_MUX_CHANNELS;
+    for (int b = 0; b < 4; b++) digitalWrite(MUX_SELECT_PINS[b], (ch >> b) & 1);
+    g_bankSensor[(mux - HAL_MUX_PIN_BASE) / HAL_MUX_CHANNELS] = sensor;
+  }
+  c.startUs = ::micros();
+  c.phase = ECHO_PHASE_ARMED;   // echo lên ~450µs sau trigger, đã arm trước đó
+  hal::writePin(trig, true); delayMicroseconds(10);   // qua I2C thì xung tự dài hơn (~50µs), HC-SR04 vẫn nhận
+  hal::writePin(trig, false);
+}
+
+EchoStatus ultrasonicPoll(uint8_t sensor, uint32_t timeoutUs, uint32_t& echoUs) {
+  echoUs = 0;
+  if (sensor >= HAL_MAX_DEVICES) return ECHO_IDLE;
+  EchoCapture& c = g_echo[sensor];
+  switch (c.phase) {
+    case ECHO_PHASE_IDLE: return ECHO_IDLE;
+    case ECHO_PHASE_DONE:
+      echoUs = c.widthUs <= timeoutUs ? c.widthUs : 0;
+      c.phase = ECHO_PHASE_IDLE;
+      return ECHO_READY;
+    default:
+      // Giống pulseIn: timeout tính từ trigger; HC-SR04 không có vật cản giữ echo ~38ms
+      if (::micros() - c.startUs < timeoutUs) return ECHO_PENDING;
+      c.phase = ECHO_PHASE_IDLE;
+      return ECHO_READY;
+  }
+}
+
+// ================== SERVO ==================
+void servoBegin(uint8_t servo, uint8_t pin) {
+  if (servo < HAL_MAX_DEVICES && pin != HAL_NO_PIN) g_servos[servo].attach(pin);
+}
+void servoWrite(uint8_t servo, int angle) {
+  if (servo < HAL_MAX_DEVICES && g_servos[servo].attached()) g_servos[servo].write(angle);
+}
+
+// ================== WIFI ==================
+bool wifiConnect(const char* ssid, const char* pass, uint32_t timeoutMs) {
+  WiFi.mode(WIFI_STA); WiFi.begin(ssid, pass);
+  uint32_t start = ::millis();
+  while (WiFi.status() != WL_CONNECTED && ::millis() - start < timeoutMs) {
+    Serial.print(".");
+    ::delay(500);
+  }
+  return WiFi.status() == WL_CONNECTED;
+}
+bool wifiConnected() { return WiFi.status() == WL_CONNECTED; }
+void wifiReconnect() { WiFi.reconnect(); }
+
+static WiFiUDP g_udp;
+bool udpSend(const char* host, uint16_t port, const char* data, size_t len) {
+  IPAddress ip;
+  if (!ip.fromString(host) || WiFi.status() != WL_CONNECTED) return false;
+  if (!g_udp.beginPacket(ip, port)) return false;
+  g_udp.write((const uint8_t*)data, len);
+  return g_udp.endPacket() == 1;
+}
+
+// ================== HTTP ==================
+void httpInit(uint32_t timeoutMs) {
+  g_httpTimeoutMs = timeoutMs;
+  g_tlsClient.setInsecure();
+  g_tlsClient.setTimeout(timeoutMs);
+}
+
+// "https://host[:port]/path" → host, port
+static bool splitUrl(const char* url, char* host, size_t hostSize, uint16_t& port) {
+  const char* start = strstr(url, "://");
+  if (!start) return false;
+  start += 3;
+  size_t len = strcspn(start, ":/");
+  if (len == 0 || len >= hostSize) return false;
+  memcpy(host, start, len);
+  host[len] = 0;
+  port = start[len] == ':' ? (uint16_t)atoi(start + len + 1) : (strncmp(url, "https", 5) == 0 ? 443 : 80);
+  return true;
+}
+
+// Giữ kết nối nếu còn sống, cùng host và chưa rảnh quá lâu; ngược lại handshake mới
+static bool ensureConnection(const char* host, uint16_t port, bool& reused) {
+  char key[sizeof(g_connKey)];
+  snprintf(key, sizeof(key), "%s:%u", host, port);
+  reused = g_tlsClient.connected() && !strcmp(key, g_connKey) && ::millis() - g_lastUseMs < HAL_HTTP_KEEPALIVE_IDLE_MS;
+  if (reused) return true;
+
+  g_tlsClient.stop();
+  uint32_t t0 = ::millis();
+  bool ok = g_tlsClient.connect(host, port);
+  g_httpStats.handshakes++;
+  g_httpStats.handshakeMs += ::millis() - t0;
+  snprintf(g_connKey, sizeof(g_connKey), "%s", ok ? key : "");
+  return ok;
+}
+
+// Body response trên socket keep-alive: dừng đúng cuối body (Content-Length hoặc chunk 0),
+// tự bỏ dòng kích thước chunk; đệm nhỏ để không đọc TLS từng byte
+class BodyStream : public Stream {
+public:
+  BodyStream(Client& client, int contentLength, bool chunked)
+    : client_(client), left_(chunked ? 0 : contentLength), chunked_(chunked) {
+    setTimeout(0);   // fill() đã chờ theo timeout của socket; hết body thì trả ngay, không chờ thêm
+  }
+  int available() override { return end_ - pos_ + (!done_ && client_.available() > 0 ? 1 : 0); }
+  int read() override { return fill() ? buf_[pos_++] : -1; }
+  int peek() override { return fill() ? buf_[pos_] : -1; }
+  size_t readBytes(char* out, size_t len) override {
+    size_t n = 0;
+    while (n < len && fill()) {
+      size_t take = end_ - pos_ < len - n ? end_ - pos_ : len - n;
+      memcpy(out + n, buf_ + pos_, take);
+      pos_ += take; n += take;
+    }
+    return n;
+  }
+  size_t write(uint8_t) override { return 0; }
+  void drain() { while (fill()) pos_ = end_; }
+
+private:
+  int readByte() { uint8_t c; return client_.readBytes(&c, 1) == 1 ? c : -1; }
+
+  // "<hex>[;ext]\r\n" → kích thước chunk; trước mỗi chunk (trừ chunk đầu) là CRLF của chunk trước
+  bool nextChunk() {
+    if (started_ && (readByte() != '\r' || readByte() != '\n')) return false;
+    started_ = true;
+    int32_t size = 0; int c; bool ext = false, any = false;
+    while ((c = readByte()) >= 0 && c != '\n') {
+      if (c == ';') ext = true;
+      if (ext || c == '\r') continue;
+      int digit = isdigit(c) ? c - '0' : (isxdigit(c) ? (tolower(c) - 'a' + 10) : -1);
+      if (digit < 0) return false;
+      size = size * 16 + digit; any = true;
+    }
+    if (c < 0 || !any) return false;
+    left_ = size;
+    if (size == 0) { readByte(); readByte(); return false; }   // CRLF cuối (không có trailer)
+    return true;
+  }
+
+  bool fill() {
+    if (pos_ < end_) return true;
+    if (done_) return false;
+    if (chunked_ && left_ == 0 && !nextChunk()) { done_ = true; return false; }
+    if (left_ == 0 || (left_ < 0 && !client_.connected() && !client_.available())) { done_ = true; return false; }
+    size_t want = (left_ < 0 || left_ > (int32_t)sizeof(buf_)) ? sizeof(buf_) : (size_t)left_;
+    int n = client_.readBytes(buf_, want);
+    if (n <= 0) { done_ = true; return false; }
+    if (left_ > 0) left_ -= n;
+    pos_ = 0; end_ = (uint8_t)n;
+    return true;
+  }
+
+  Client& client_;
+  int32_t left_;       // byte còn lại của body (Content-Length) / chunk hiện tại; -1 = tới khi server đóng
+  bool chunked_;
+  bool started_ = false, done_ = false;
+  uint8_t buf_[64];
+  uint8_t pos_ = 0, end_ = 0;
+};
+
+static int sendOnce(const HttpRequest& req, HttpBodyReader reader, void* ctx) {
+  HTTPClient https; https.setReuse(true); https.setTimeout(g_httpTimeoutMs); https.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+  https.setUserAgent("ESP32-ParkingSystem/1.4");
+  // begin() thấy g_tlsClient đang kết nối → dùng lại, không handshake
+  if (!https.begin(g_tlsClient, req.url)) return HTTPC_ERROR_CONNECTION_REFUSED;
+  static const char* RESPONSE_HEADERS[] = {"Transfer-Encoding"};
+  https.collectHeaders(RESPONSE_HEADERS, 1);
+
+  // HTTPClient giữ header bằng String (heap của core); body gửi thẳng từ buffer của nơi gọi
+  https.addHeader("Accept", "application/json");
+  https.addHeader("ngrok-skip-browser-warning", "true");
+  if (req.bearer[0]) https.addHeader("Authorization", String("Bearer ") + req.bearer);
+  if (req.body[0]) https.addHeader("Content-Type", "application/json");
+  if (req.extraHeaders) {
+    for (const char* const* h = req.extraHeaders; h[0] && h[1]; h += 2) https.addHeader(h[0], h[1]);
+  }
+
+  int code = https.sendRequest(req.method, (uint8_t*)req.body, strlen(req.body));
+  if (code > 0) {
+    BodyStream body(*https.getStreamPtr(), https.getSize(), https.header("Transfer-Encoding").equalsIgnoreCase("chunked"));
+    if (reader) reader(code, body, ctx);
+    body.drain();
+  }
+  https.end();                      // server trả Connection: keep-alive → giữ socket
+  return code;
+}
+
+int httpRequest(const HttpRequest& req, HttpBodyReader reader, void* ctx) {
+  char host[64]; uint16_t port;
+  if (!splitUrl(req.url, host, sizeof(host), port)) return HTTPC_ERROR_CONNECTION_REFUSED;
+  g_httpStats.requests++;
+
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    bool reused = false;
+    if (!ensureConnection(host, port, reused)) return HTTPC_ERROR_CONNECTION_REFUSED;
+    int code = sendOnce(req, reader, ctx);
+    g_lastUseMs = ::millis();
+    // Socket keep-alive bị đóng phía server mà chưa gửi được request → mở kết nối mới, gửi lại một lần
+    bool staleSocket = code == HTTPC_ERROR_SEND_HEADER_FAILED || code == HTTPC_ERROR_NOT_CONNECTED;
+    if (reused && staleSocket) { g_tlsClient.stop(); continue; }
+    if (code <= 0) g_tlsClient.stop();
+    return code;
+  }
+  return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+const char* httpErrorToString(int code) {
+  static char text[40];
+  snprintf(text, sizeof(text), "%s", HTTPClient::errorToString(code).c_str());
+  return text;
+}
+HttpStats httpStats() { return g_httpStats; }
+
+// ================== TASK + HÀNG ĐỢI ==================
+static TickType_t toTicks(uint32_t timeoutMs) { return timeoutMs == WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs); }
+
+Queue queueCreate(uint16_t length, uint16_t itemSize) { return xQueueCreate(length, itemSize); }
+bool queueSend(Queue queue, const void* item, uint32_t timeoutMs) {
+  return xQueueSend((QueueHandle_t)queue, item, toTicks(timeoutMs)) == pdTRUE;
+}
+bool queueReceive(Queue queue, void* item, uint32_t timeoutMs) {
+  return xQueueReceive((QueueHandle_t)queue, item, toTicks(timeoutMs)) == pdTRUE;
+}
+bool taskStart(const char* name, void (*fn)(void*), void* arg, uint32_t stackBytes, uint8_t priority, int core) {
+  return xTaskCreatePinnedToCore(fn, name, stackBytes, arg, priority, nullptr, core) == pdPASS;
+}
+
+// ================== FLASH ==================
+static bool flashReady() {
+  if (g_journalPart || g_ramFlash) return true;
+  g_journalPart = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "journal");
+  if (g_journalPart) return true;
+  Serial.println("⚠️ Không có phân vùng 'journal' → journal tạm trong RAM (mất khi reset)");
+  g_ramFlash = (uint8_t*)malloc(RAM_FLASH_BYTES);
+  if (g_ramFlash) memset(g_ramFlash, 0xFF, RAM_FLASH_BYTES);
+  return g_ramFlash != nullptr;
+}
+
+uint32_t flashSize() {
+  if (!flashReady()) return 0;
+  return g_journalPart ? g_journalPart->size : RAM_FLASH_BYTES;
+}
+
+bool flashRead(uint32_t offset, void* buf, uint32_t len) {
+  if (offset + len > flashSize()) return false;
+  if (g_journalPart) return esp_partition_read(g_journalPart, offset, buf, len) == ESP_OK;
+  memcpy(buf, g_ramFlash + offset, len);
+  return true;
+}
+
+bool flashWrite(uint32_t offset, const void* buf, uint32_t len) {
+  if (offset + len > flashSize()) return false;
+  if (g_journalPart) return esp_partition_write(g_journalPart, offset, buf, len) == ESP_OK;
+  const uint8_t* src = (const uint8_t*)buf;
+  for (uint32_t i = 0; i < len; i++) g_ramFlash[offset + i] &= src[i];
+  return true;
+}
+
+bool flashEraseSector(uint32_t offset) {
+  if (offset % HAL_FLASH_SECTOR_SIZE || offset + HAL_FLASH_SECTOR_SIZE > flashSize()) return false;
+  if (g_journalPart) return esp_partition_erase_range(g_journalPart, offset, HAL_FLASH_SECTOR_SIZE) == ESP_OK;
+  memset(g_ramFlash + offset, 0xFF, HAL_FLASH_SECTOR_SIZE);
+  return true;
+}
+
+// ================== HỆ THỐNG ==================
+uint32_t freeHeap() { return ESP.getFreeHeap(); }
+uint32_t randomSeedValue() { return esp_random(); }
+const char* deviceId() {
+  static char id[13];
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(id, sizeof(id), "%04X%08X", (uint16_t)(mac >> 32), (uint32_t)mac);
+  return id;
+}
+
+}  // namespace hal
@@ -0,0 +1,136 @@
+// == Journal sự kiện trên flash (xem include/journal.h) ==
+#include "journal.h"
+#include "hal.h"
+
+#include <stddef.h>
+#include <string.h>
+
+struct Record {
+  uint32_t seq;
+  uint8_t  len;
+  uint8_t  reserved[3];
+  uint8_t  payload[JOURNAL_PAYLOAD_SIZE];
+  uint32_t crc;        // CRC32 của các byte phía trước
+  uint32_t consumed;   // 0xFFFFFFFF = chưa gửi, 0 = đã gửi
+};
+static_assert(sizeof(Record) == JOURNAL_RECORD_SIZE, "Record phải đúng JOURNAL_RECORD_SIZE");
+
+static const uint32_t PER_SECTOR = HAL_FLASH_SECTOR_SIZE / JOURNAL_RECORD_SIZE;
+static const uint32_t UNCONSUMED = 0xFFFFFFFFu;
+
+static bool     g_ready = false;
+static uint32_t g_slots = 0;     // số ô bản ghi trong vùng flash
+static uint32_t g_head = 0;      // ô ghi kế tiếp
+static uint32_t g_tail = 0;      // ô của bản ghi cũ nhất chưa gửi
+static uint32_t g_pending = 0;
+static uint32_t g_nextSeq = 1;
+
+static uint32_t crc32(const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t crc = 0xFFFFFFFFu;
+  while (len--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static uint32_t next(uint32_t slot) { return slot + 1 == g_slots ? 0 : slot + 1; }
+static uint32_t offsetOf(uint32_t slot) { return slot * JOURNAL_RECORD_SIZE; }
+
+static bool readValid(uint32_t slot, Record& r) {
+  if (!hal::flashRead(offsetOf(slot), &r, sizeof(r))) return false;
+  return r.seq != 0xFFFFFFFFu && r.len <= JOURNAL_PAYLOAD_SIZE && r.crc == crc32(&r, offsetof(Record, crc));
+}
+
+static bool blank(uint32_t slot) {
+  uint32_t words[JOURNAL_RECORD_SIZE / 4];
+  if (!hal::flashRead(offsetOf(slot), words, sizeof(words))) return false;
+  for (uint32_t w : words) if (w != 0xFFFFFFFFu) return false;
+  return true;
+}
+
+// Bỏ qua ô hỏng (mất điện giữa lúc ghi) để tail trỏ vào bản ghi chưa gửi kế tiếp
+static void skipInvalidTail() {
+  Record r;
+  while (g_tail != g_head && !(readValid(g_tail, r) && r.consumed == UNCONSUMED)) g_tail = next(g_tail);
+}
+
+namespace journal {
+
+bool begin() {
+  // Chỉ dùng sector trọn vẹn; cần ≥ 2 sector để xoá sector kế tiếp không đụng bản ghi đang chờ
+  g_slots = hal::flashSize() / HAL_FLASH_SECTOR_SIZE * PER_SECTOR;
+  g_ready = g_slots >= 2 * PER_SECTOR;
+  if (!g_ready) return false;
+
+  uint32_t maxSeq = 0, minPendingSeq = 0xFFFFFFFFu;
+  g_head = 0; g_tail = 0; g_pending = 0;
+  for (uint32_t slot = 0; slot < g_slots; slot++) {
+    Record r;
+    if (!readValid(slot, r)) continue;
+    if (r.seq > maxSeq) { maxSeq = r.seq; g_head = next(slot); }
+    if (r.consumed != UNCONSUMED) continue;
+    g_pending++;
+    if (r.seq < minPendingSeq) { minPendingSeq = r.seq; g_tail = slot; }
+  }
+  if (g_pending == 0) g_tail = g_head;
+  g_nextSeq = maxSeq + 1;
+  return true;
+}
+
+bool append(const void* payload, uint8_t len, uint32_t& outSeq) {
+  if (!g_ready || len > JOURNAL_PAYLOAD_SIZE) return false;
+  for (uint32_t tries = 0; tries < g_slots; tries++) {
+    if (g_head % PER_SECTOR == 0) {
+      // Vào sector mới: xoá trước khi ghi, trừ khi sector còn bản ghi chưa gửi (journal đầy)
+      if (g_pending > 0 && g_tail / PER_SECTOR == g_head / PER_SECTOR) return false;
+      if (!hal::flashEraseSector(offsetOf(g_head))) return false;
+    } else if (!blank(g_head)) {
+      g_head = next(g_head);
+      continue;
+    }
+
+    Record r;
+    memset(&r, 0, sizeof(r));
+    r.seq = g_nextSeq;
+    r.len = len;
+    memcpy(r.payload, payload, len);
+    r.crc = crc32(&r, offsetof(Record, crc));
+    r.consumed = UNCONSUMED;
+    if (!hal::flashWrite(offsetOf(g_head), &r, sizeof(r))) return false;
+
+    if (g_pending++ == 0) g_tail = g_head;
+    g_head = next(g_head);
+    outSeq = g_nextSeq++;
+    return true;
+  }
+  return false;
+}
+
+bool peek(void* payload, uint8_t& len, uint32_t& outSeq) {
+  if (g_pending == 0) return false;
+  Record r;
+  if (!readValid(g_tail, r)) return false;
+  memcpy(payload, r.payload, r.len);
+  len = r.len;
+  outSeq = r.seq;
+  return true;
+}
+
+bool pop() {
+  if (g_pending == 0) return false;
+  uint32_t done = 0;
+  if (!hal::flashWrite(offsetOf(g_tail) + offsetof(Record, consumed), &done, sizeof(done))) return false;
+  g_pending--;
+  g_tail = next(g_tail);
+  if (g_pending == 0) g_tail = g_head;
+  else skipInvalidTail();
+  return true;
+}
+
+uint32_t pending() { return g_pending; }
+uint32_t capacity() { return g_slots; }
+uint32_t nextSeq() { return g_nextSeq; }
+
+}  // namespace journal
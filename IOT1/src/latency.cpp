@@ -0,0 +1,98 @@
+// == Histogram độ trễ theo giai đoạn (xem include/latency.h) ==
+#include "latency.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace latency {
+
+// CCOUNT tràn sau 2^32 / 240MHz ≈ 17,9s → span dài hơn thì tính bằng millis()
+static const uint32_t CYCLE_SPAN_MAX_MS = 10000;
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = {
+  "range", "filter", "react", "gate", "login", "plate", "checkin", "checkout", "event", "status", "arrival",
+};
+
+// seq lẻ = đang ghi; chỉ một task ghi mỗi stage nên không cần khoá phía ghi
+struct Entry {
+  volatile uint32_t seq;
+  Histogram h;
+};
+static Entry g_stages[STAGE_COUNT];
+
+uint32_t elapsedUs(const Mark& from) {
+  uint32_t ms = hal::millis() - from.ms;
+  if (ms >= CYCLE_SPAN_MAX_MS) return ms < 0xFFFFFFFFu / 1000 ? ms * 1000 : 0xFFFFFFFFu;
+  return (hal::cycles() - from.cycles) / hal::cyclesPerUs();
+}
+
+static int bucketOf(uint32_t us) {
+  int k = us ? 31 - __builtin_clz(us) : 0;
+  return k < LATENCY_BUCKETS ? k : LATENCY_BUCKETS - 1;
+}
+
+void record(Stage stage, uint32_t us) {
+  if (stage >= STAGE_COUNT) return;
+  Entry& s = g_stages[stage];
+  s.seq = s.seq + 1;
+  __sync_synchronize();
+  s.h.count++;
+  s.h.sumUs += us;
+  if (us > s.h.maxUs) s.h.maxUs = us;
+  s.h.buckets[bucketOf(us)]++;
+  __sync_synchronize();
+  s.seq = s.seq + 1;
+}
+
+void snapshot(Stage stage, Histogram& out) {
+  const Entry& s = g_stages[stage];
+  uint32_t seq;
+  do {
+    while ((seq = s.seq) & 1) {}
+    __sync_synchronize();
+    memcpy(&out, (const void*)&s.h, sizeof(out));
+    __sync_synchronize();
+  } while (s.seq != seq);
+}
+
+uint32_t percentileUs(const Histogram& h, uint32_t permille) {
+  if (!h.count) return 0;
+  uint64_t target = ((uint64_t)h.count * permille + 999) / 1000;
+  uint64_t seen = 0;
+  for (int k = 0; k < LATENCY_BUCKETS; k++) {
+    seen += h.buckets[k];
+    if (seen < target || !seen) continue;
+    uint32_t upper = k + 1 < 32 ? (1u << (k + 1)) - 1 : 0xFFFFFFFFu;
+    return upper < h.maxUs ? upper : h.maxUs;
+  }
+  return h.maxUs;
+}
+
+const char* stageName(Stage stage) { return stage < STAGE_COUNT ? STAGE_NAMES[stage] : "?"; }
+
+size_t frame(char* out, size_t cap) {
+  if (!cap) return 0;
+  int n = snprintf(out, cap, "@lat 1 %lu", (unsigned long)hal::millis());
+  if (n < 0 || (size_t)n >= cap) { out[0] = 0; return 0; }
+  size_t len = n;
+  for (int st = 0; st < STAGE_COUNT; st++) {
+    Histogram h;
+    snapshot((Stage)st, h);
+    if (!h.count) continue;
+    char item[512];   // 26 bucket × ",25=4294967295" vẫn vừa
+    size_t il = snprintf(item, sizeof(item), " %s:%lu:%llu:%lu:", STAGE_NAMES[st], (unsigned long)h.count,
+                         (unsigned long long)h.sumUs, (unsigned long)h.maxUs);
+    bool first = true;
+    for (int k = 0; k < LATENCY_BUCKETS && il < sizeof(item); k++) {
+      if (!h.buckets[k]) continue;
+      il += snprintf(item + il, sizeof(item) - il, "%s%d=%lu", first ? "" : ",", k, (unsigned long)h.buckets[k]);
+      first = false;
+    }
+    if (il >= sizeof(item) || len + il >= cap) break;   // không cắt giữa một stage
+    memcpy(out + len, item, il + 1);
+    len += il;
+  }
+  return len;
+}
+
+}  // namespace latency
@@ -4,18 +4,36 @@
 // - Check-in luôn ghi đúng plate + user_id chủ xe (ưu tiên user tra biển số;
 //   nếu không có, vẫn check-in, rồi lấy user_id từ server: data.history.user_id)
 // - Hiển thị user_id đúng theo lịch sử trên server (không nhầm với admin)
-// - Non-blocking (millis), mỗi slot có state machine riêng
-// - Parse timestamp linh hoạt, historyId 64-bit, refresh token 401
-
-#include <WiFi.h>
-#include <WiFiClientSecure.h>
-#include <HTTPClient.h>
-#include <ESP32Servo.h>
+// - Non-blocking (millis), mỗi slot có state machine riêng; echo siêu âm bắt bằng ngắt GPIO
+// - API call chạy trên network task (core 0) qua hàng đợi, loop() không chờ HTTP
+// - Xe vào/ra = 1 request slot event (server cũ: GET plate + check-in/out + PUT status)
+// - Sự kiện ghi vào journal trên flash trước khi gửi → mất WiFi/reset không mất xe vào/ra;
+//   có mạng lại thì gửi bù đúng thứ tự, giới hạn tốc độ, kèm event_id chống ghi trùng
+// - Cache biển số → userId (LRU + TTL, cả plate chưa đăng ký) → khách quen không tốn GET plate
+// - Response JSON parse theo luồng từ socket + filter (chỉ id/user_id/timestamp), đo RAM/request
+// - Không cấp phát heap khi chạy ổn định: chuỗi là mảng char cố định, URL/body/JSON document
+//   nằm trong scratch arena (include/scratch.h) trả lại sau mỗi request
+// - Parse timestamp linh hoạt, historyId 64-bit; token refresh nền trước hạn exp của JWT (401 vẫn login lại)
+// - Có xe/trống qua bộ lọc median + EMA + xác nhận (include/slot_filter.h) → echo lạc không thành check-in
+// - Độ trễ từng giai đoạn (đo, lọc, cổng, từng API, xe vào → server) thành histogram (include/latency.h),
+//   in gọn trong printStatus + frame "@lat" cho máy đọc qua Serial/UDP
+// - Serial chỉ in dòng slot vừa đổi (+ tổng hợp định kỳ), cả bảng khi gõ 's' → log không tăng theo số slot
+// - Số slot + chân cắm sinh lúc compile (include/slot_config.h: 4/16/64 slot, expander + mux)
+// - Phần cứng/mạng qua hal::* (include/hal.h) → build được cả trên Linux (make host)
+
+#include "hal.h"
+#include "journal.h"
+#include "latency.h"
+#include "scratch.h"
+#include "slot_config.h"
+#include "slot_filter.h"
 #include <ArduinoJson.h>
-#include <functional>
+#include <initializer_list>
+#include <math.h>
+#include <stdarg.h>
 
 // ================== CẤU HÌNH ==================
-#define NUM_SLOTS 4
+// Số slot + chân cắm: include/slot_config.h (SLOT_LAYOUT = 4/16/64)
 const char* WIFI_SSID = "Wokwi-GUEST";
 const char* WIFI_PASS = "";
 
@@ -26,6 +44,11 @@ const char* FIND_PLATE_PATH = "/api/users/license-plate/";
 const char* CHECKIN_PATH    = "/api/parking/checkin";
 const char* CHECKOUT_PATH   = "/api/parking/checkout";
 const char* SLOT_STATUS_PUT_FMT = "/api/slots/%d/status";
+const char* SLOT_STATUS_BULK_PATH = "/api/slots/status";   // PUT {"slots":[{"id","status"}]}
+// Slot event gộp: 1 request thay cho GET plate + check-in + PUT status (xe ra: check-out + PUT status).
+// Server cũ trả 404 → network task tự quay về chuỗi request cũ
+#define USE_SLOT_EVENT 1
+const char* SLOT_EVENT_PATH = "/api/parking/slot-event";
 
 // Supabase REST fallback (TẮT mặc định)
 #define USE_SUPABASE_FALLBACK 0
@@ -40,145 +63,437 @@ const char* LOGIN_PASSWORD  = "123456";
 static const uint32_t HTTP_TIMEOUT_MS        = 20000;
 static const uint8_t  MAX_HTTP_RETRIES       = 2;
 static const uint8_t  MAX_AUTH_RETRIES       = 1;
+// JWT: network task login lại khi còn 1/TOKEN_REFRESH_DIV thời hạn (24h → trước 2,4h);
+// lỗi (mất mạng, server lỗi) thì thử lại sau TOKEN_RETRY_MS
+static const uint32_t TOKEN_REFRESH_DIV      = 10;
+static const uint32_t TOKEN_RETRY_MS         = 30000;
 static const uint32_t WIFI_RETRY_DELAY_MS    = 5000;
+static const uint32_t WIFI_CONNECT_TIMEOUT_MS = 15000; // 30 lần × 500ms
 static const uint32_t ULTRA_TIMEOUT_US       = 30000;
 static const uint32_t SERVO_OPEN_DURATION_MS = 3000; // Servo mở 3s
 
 // Scheduler
 static const uint32_t SENSE_INTERVAL_MS = 120;
+// Đo khoảng cách theo lượt: mỗi lượt bắn RANGING_CONCURRENCY cảm biến cách nhau RANGING_STRIDE slot
+// (không bao giờ 2 cảm biến kề nhau cùng lúc → không nhiễu chéo), lượt kế tiếp sau khi
+// echo về hết và RANGING_WINDOW_MS (echo tối đa 30ms + chờ dư âm tắt)
+static const uint32_t RANGING_WINDOW_MS   = 40;
+static const int      RANGING_CONCURRENCY = SLOT_RANGING_CONCURRENCY;
+static const int      RANGING_STRIDE      = (NUM_SLOTS + RANGING_CONCURRENCY - 1) / RANGING_CONCURRENCY;
 static const uint32_t PRINT_INTERVAL_MS = 5000;
-
-// Hysteresis
-const float OCCUPY_THRESH = 10.0f;
-const float FREE_THRESH   = 14.0f;
+// Telemetry độ trễ: frame "@lat" in ra Serial mỗi PRINT_INTERVAL_MS, gửi thêm UDP nếu có IP máy thu
+// (chỉ IP, không tra DNS → loop() không chờ). "" = chỉ Serial
+#ifndef TELEMETRY_UDP_HOST
+#define TELEMETRY_UDP_HOST ""
+#endif
+static const uint16_t TELEMETRY_UDP_PORT = 9750;
+
+// Network task: chạy trên core 0 (loop() của Arduino ở core 1). Job được chuyển vào journal
+// giữa các request; 4×NUM_SLOTS đủ cho vài lượt xe vào/ra mỗi slot trong lúc một request treo.
+// Chặn ở 64: bãi lớn không cùng lúc có xe ở mọi slot, 2 hàng đợi × 256 job thì tốn RAM vô ích
+static const uint16_t NET_QUEUE_LENGTH  = 4 * NUM_SLOTS < 64 ? 4 * NUM_SLOTS : 64;
+static const uint32_t NET_TASK_STACK    = 12288;   // TLS handshake + ArduinoJson
+static const uint8_t  NET_TASK_PRIORITY = 1;
+static const int      NET_TASK_CORE     = 0;
+
+// Trạng thái slot gửi theo lô: mỗi slot chỉ giữ trạng thái mới nhất, gửi 1 PUT khi đủ
+// STATUS_BATCH_MAX slot hoặc STATUS_BATCH_WINDOW_MS sau thay đổi đầu tiên; lỗi → thử lại sau
+// WIFI_RETRY_DELAY_MS (vẫn gom tiếp trong lúc chờ)
+static const uint32_t STATUS_BATCH_WINDOW_MS = 500;
+static const int      STATUS_BATCH_MAX       = NUM_SLOTS;
+
+// Gửi bù journal: tối đa REPLAY_BURST sự kiện liền nhau, sau đó 1 sự kiện / REPLAY_INTERVAL_MS.
+// Có WiFi lại thì chờ ngẫu nhiên 0..REPLAY_JITTER_MS (hàng trăm node không dồn cùng lúc);
+// lỗi tạm (mất mạng, 5xx, login fail) → lùi REPLAY_BACKOFF_MIN_MS, nhân đôi tới REPLAY_BACKOFF_MAX_MS
+static const uint32_t REPLAY_INTERVAL_MS    = 500;
+static const uint32_t REPLAY_BURST          = 4;
+static const uint32_t REPLAY_JITTER_MS      = 3000;
+static const uint32_t REPLAY_BACKOFF_MIN_MS = 1000;
+static const uint32_t REPLAY_BACKOFF_MAX_MS = 60000;
+static const uint32_t WIFI_POLL_MS          = 1000;   // network task kiểm tra WiFi khi có sự kiện chờ
+
+// Cache biển số → userId (LRU, bộ nhớ cố định): khách quen không tốn 1 round trip HTTPS mỗi lần vào.
+// Plate chưa đăng ký (404) cũng được cache (negative) nhưng TTL ngắn hơn để đăng ký mới sớm có hiệu lực
+static const int      PLATE_CACHE_SIZE       = 16;
+static const uint32_t PLATE_CACHE_TTL_MS     = 30UL * 60 * 1000;
+static const uint32_t PLATE_CACHE_NEG_TTL_MS = 5UL * 60 * 1000;
+
+// Lọc khoảng cách → có xe/trống: median + EMA + xác nhận, ngưỡng hysteresis 10/14cm
+// (giá trị mặc định và ý nghĩa: include/slot_filter.h; chỉnh thử bằng make eval)
+static const FilterParams SLOT_FILTER = {};
+
+// Chuỗi cố định (không heap): UUID 36 ký tự, id 64-bit, timestamp ISO-8601
+typedef char PlateStr[16];
+typedef char UserIdStr[40];
+typedef char HistoryIdStr[24];
+typedef char TimeStr[40];
+typedef char AuthTokenStr[512];   // JWT của backend cỡ 200–300 ký tự
 
 // ================== DỮ LIỆU DEMO ==================
-struct DatabaseEntry { String plate; };
+struct DatabaseEntry { const char* plate; };
 const DatabaseEntry DATABASE[] = {
   {"51D-22222"}, {"51D-22223"}, {"51A-12345"}, {"29B-67890"}, {"99A-99999"}
 };
 const int DATABASE_COUNT = sizeof(DATABASE)/sizeof(DATABASE[0]);
 
 struct ParkedCar {
-  String plate;
-  int    slotId;
-  String userId;     // user_id chủ xe (đồng bộ với server)
-  String historyId;
-  String checkInAt;
-  String checkOutAt;
+  bool         parked;
+  PlateStr     plate;
+  UserIdStr    userId;     // user_id chủ xe (đồng bộ với server)
+  HistoryIdStr historyId;
+  TimeStr      checkInAt;
+  TimeStr      checkOutAt;
 };
 
 // ================== SLOT STATE ==================
-enum SlotState { SLOT_IDLE, SLOT_OPENING, SLOT_WAIT_CLOSE };
+enum SlotState : uint8_t { SLOT_IDLE, SLOT_OPENING, SLOT_WAIT_CLOSE };
 
+// Chỉ phần loop() đọc/ghi mỗi vòng: 12 byte/slot, 64 slot nằm gọn trong 768 byte liền nhau.
+// Chân cắm (phần lạnh) ở slotPins(i), include/slot_config.h
 struct Slot {
-  int trig, echo, ledGreen, ledRed, servoPin;
-  Servo servo;
-  float distance;
-  bool  occupied;
+  float     distance;        // kết quả đo gần nhất
+  uint32_t  stateStartTime;
   SlotState state;
-  unsigned long stateStartTime;
+  bool      fresh;           // có kết quả mới mà updateSlotStatus chưa xử lý
 };
+static_assert(sizeof(Slot) == 12, "Slot nóng phải giữ 12 byte");
 
-Slot slots[NUM_SLOTS] = {
-  {4, 2, 5, 18, 15, Servo(), 400, false, SLOT_IDLE, 0},
-  {19, 21, 23, 22, 13, Servo(), 400, false, SLOT_IDLE, 0},
-  {25, 26, 14, 27, 12, Servo(), 400, false, SLOT_IDLE, 0},
-  {32, 33, 0, 17, 16, Servo(), 400, false, SLOT_IDLE, 0}
-};
+Slot slots[NUM_SLOTS];   // initHardware() đặt giá trị đầu
+// Trạng thái có xe/trống của mọi slot (nguồn duy nhất), cập nhật mỗi SENSE_INTERVAL_MS
+SlotFilter<NUM_SLOTS> slotFilter;
 
+// Xe đang đậu, chỉ số = slot (slotId - 1) → thêm/tra/xoá O(1), không phụ thuộc thứ tự xe vào.
+// Chỉ loop() đọc/ghi
 ParkedCar parkedCars[NUM_SLOTS];
 int parkedCount = 0;
 
-String AUTH_TOKEN = "";
+// Bộ đếm journal: network task ghi, printStatus() chỉ đọc
+volatile uint32_t g_journalPending = 0;
+volatile uint32_t g_journalDropped = 0;  // sự kiện bỏ vì journal đầy
+
+AuthTokenStr AUTH_TOKEN = "";
 static uint8_t g_authRetry = 0;
-WiFiClientSecure g_tlsClient;
+static uint32_t g_tokenIssuedMs = 0;     // millis() lúc nhận token
+static uint32_t g_tokenLifetimeMs = 0;   // exp - iat của token; 0 = không đọc được → chỉ refresh khi 401
+static uint32_t g_authRetryAt = 0;       // refresh chủ động lỗi → chưa thử lại trước lúc này
+// Bộ đếm auth: network task ghi, printStatus() chỉ đọc
+volatile uint32_t g_authLogins = 0;      // login thành công (cả lần đầu)
+volatile uint32_t g_authProactive = 0;   // refresh trước khi hết hạn
+volatile uint32_t g_authOn401 = 0;       // login lại vì request bị 401
+volatile uint32_t g_authFailures = 0;
+volatile uint32_t g_authMs = 0;          // tổng thời gian các request login
 
 // ================== TIỆN ÍCH ==================
-String urlEncode(const String& v) {
-  String enc = ""; char buf[4];
-  for (size_t i = 0; i < v.length(); i++) {
-    char c = v.charAt(i);
-    if (('a'<=c && c<='z')||('A'<=c && c<='Z')||('0'<=c && c<='9')||c=='-'||c=='_'||c=='.'||c=='~') enc+=c;
-    else { snprintf(buf, sizeof(buf), "%%%02X", (unsigned char)c); enc+=buf; }
+template <size_t N> void copyField(char (&dst)[N], const char* src) { snprintf(dst, N, "%s", src ? src : ""); }
+
+// Giá trị id/user_id dùng được: không rỗng, không phải "null"
+bool hasValue(const char* s) { return s && s[0] && strcmp(s, "null"); }
+
+// Serial.printf của Arduino-ESP32 malloc bộ đệm khi dòng dài quá 64 byte → format trên stack
+void serialPrintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void serialPrintf(const char* fmt, ...) {
+  char line[256];
+  va_list args; va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  Serial.print(line);
+}
+
+// URL/chuỗi tạm nằm trong scratch arena: hết hạn khi ScratchScope của request đóng
+const char* urlEncode(const char* v) {
+  char* enc = (char*)scratch::alloc(strlen(v) * 3 + 1);
+  if (!enc) return "";
+  char* o = enc;
+  for (; *v; v++) {
+    char c = *v;
+    if (('a'<=c && c<='z')||('A'<=c && c<='Z')||('0'<=c && c<='9')||c=='-'||c=='_'||c=='.'||c=='~') *o++ = c;
+    else o += snprintf(o, 4, "%%%02X", (unsigned char)c);
   }
+  *o = 0;
   return enc;
 }
-String buildUrl(const char* path) { return String(BASE_URL) + String(path); }
+const char* buildUrl(const char* path) { return scratch::format("%s%s", BASE_URL, path); }
 
-void addCommonHeaders(HTTPClient& cli) {
-  cli.addHeader("Accept", "application/json");
-  cli.addHeader("User-Agent", "ESP32-ParkingSystem/1.4");
-  cli.addHeader("ngrok-skip-browser-warning", "true");
-  cli.addHeader("Connection", "close");
-  if (AUTH_TOKEN.length() > 0) cli.addHeader("Authorization", "Bearer " + AUTH_TOKEN);
-}
-bool httpBegin(HTTPClient& http, const String& url) { return http.begin(g_tlsClient, url); }
+ParkedCar* parkedAt(int slotIdx) { return parkedCars[slotIdx].parked ? &parkedCars[slotIdx] : nullptr; }
 
-int findParkedIndexBySlot(int slotId) {
-  for (int i = 0; i < parkedCount; i++) if (parkedCars[i].slotId == slotId) return i;
-  return -1;
+ParkedCar& parkCar(int slotIdx, const char* plate) {
+  ParkedCar& pc = parkedCars[slotIdx];
+  if (!pc.parked) parkedCount++;
+  pc = {};
+  pc.parked = true;
+  copyField(pc.plate, plate);
+  return pc;
 }
-void removeParkedIndex(int idx) {
-  if (idx < 0 || idx >= parkedCount) return;
-  for (int k = idx; k < parkedCount - 1; k++) parkedCars[k] = parkedCars[k + 1];
+
+void unparkCar(int slotIdx) {
+  if (!parkedCars[slotIdx].parked) return;
+  parkedCars[slotIdx].parked = false;
   parkedCount--;
 }
 
+// ================== CACHE BIỂN SỐ ==================
+// Chỉ network task (và testAPI() trước khi task chạy) đọc/ghi; printStatus() chỉ đọc bộ đếm
+struct PlateCacheEntry {
+  PlateStr  plate;
+  UserIdStr userId;     // rỗng = negative entry (plate chưa đăng ký)
+  uint32_t expiresAt;
+  uint32_t lastUsed;    // tick LRU
+  bool used;
+};
+PlateCacheEntry plateCache[PLATE_CACHE_SIZE];
+uint32_t plateCacheTick = 0;
+volatile uint32_t g_plateCacheHits = 0, g_plateCacheMisses = 0;
+
+PlateCacheEntry* plateCacheFind(const char* plate) {
+  for (auto &e : plateCache) if (e.used && !strcmp(plate, e.plate)) return &e;
+  return nullptr;
+}
+
+// true: có entry còn hạn (outUserId rỗng = plate chưa đăng ký)
+bool plateCacheGet(const char* plate, UserIdStr& outUserId) {
+  PlateCacheEntry* e = plateCacheFind(plate);
+  if (e && (int32_t)(e->expiresAt - hal::millis()) <= 0) { e->used = false; e = nullptr; }
+  if (!e) { g_plateCacheMisses++; return false; }
+  e->lastUsed = ++plateCacheTick;
+  memcpy(outUserId, e->userId, sizeof(outUserId));
+  g_plateCacheHits++;
+  return true;
+}
+
+void plateCachePut(const char* plate, const char* userId) {
+  if (strlen(plate) >= sizeof(plateCache[0].plate) || strlen(userId) >= sizeof(plateCache[0].userId)) return;
+  PlateCacheEntry* e = plateCacheFind(plate);
+  if (!e) {   // ô trống, không có thì đè ô dùng lâu nhất
+    e = &plateCache[0];
+    for (auto &c : plateCache) {
+      if (!c.used) { e = &c; break; }
+      if (c.lastUsed < e->lastUsed) e = &c;
+    }
+  }
+  snprintf(e->plate, sizeof(e->plate), "%s", plate);
+  snprintf(e->userId, sizeof(e->userId), "%s", userId);
+  e->expiresAt = hal::millis() + (userId[0] ? PLATE_CACHE_TTL_MS : PLATE_CACHE_NEG_TTL_MS);
+  e->lastUsed = ++plateCacheTick;
+  e->used = true;
+}
+
+void plateCacheInvalidate(const char* plate) {
+  PlateCacheEntry* e = plateCacheFind(plate);
+  if (e) e->used = false;
+}
+
+void plateCacheClear() { for (auto &e : plateCache) e.used = false; }
+
+// Server ghi history cho user khác với cache (biển số đổi chủ / mới đăng ký) → bỏ entry
+void plateCacheCheck(const char* plate, const char* serverUserId) {
+  PlateCacheEntry* e = plateCacheFind(plate);
+  if (!e || !e->userId[0] || !hasValue(serverUserId)) return;
+  if (strcmp(serverUserId, e->userId)) {
+    serialPrintf("♻️ Cache biển số lệch với server → bỏ: %s\n", plate);
+    e->used = false;
+  }
+}
+
 // ================== JSON HELPERS ==================
-String parseTimestamp(const JsonVariant& json, const char* a, const char* b, const char* c, const char* d) {
-  if (json[a].is<String>() && json[a].as<String>().length() > 0) return json[a].as<String>();
-  if (json[b].is<String>() && json[b].as<String>().length() > 0) return json[b].as<String>();
-  if (json[c].is<String>() && json[c].as<String>().length() > 0) return json[c].as<String>();
-  if (json[d].is<String>() && json[d].as<String>().length() > 0) return json[d].as<String>();
+// Trỏ vào document (chỉ dùng khi document còn sống); "" nếu không có
+const char* parseTimestamp(JsonVariant json, const char* a, const char* b, const char* c, const char* d) {
+  for (const char* key : {a, b, c, d}) {
+    const char* v = json[key].as<const char*>();
+    if (v && v[0]) return v;
+  }
   return "";
 }
 
+// Giá trị của node đầu tiên có dữ liệu (chuỗi, hoặc số như id 64-bit) → out.
+// false nếu không node nào có hoặc dài quá out (out giữ nguyên / rỗng)
+template <size_t N> bool firstValue(char (&out)[N], std::initializer_list<JsonVariant> nodes) {
+  for (JsonVariant v : nodes) {
+    int n;
+    if (v.is<const char*>())    n = snprintf(out, N, "%s", v.as<const char*>());
+    else if (v.is<long long>()) n = snprintf(out, N, "%lld", v.as<long long>());
+    else continue;
+    if (n >= 0 && (size_t)n < N) return true;
+    out[0] = 0;
+    return false;
+  }
+  return false;
+}
+
+// Body request: document dựng trong scope riêng, chỉ chuỗi JSON (tối đa maxLen - 1 ký tự)
+// ở lại arena tới hết request. "" nếu arena hết chỗ hoặc body dài quá
+template <typename Fill> const char* jsonBody(size_t maxLen, Fill fill) {
+  char* out = (char*)scratch::alloc(maxLen);
+  if (!out) return "";
+  ScratchScope scope;
+  JsonDocument doc(scratch::json());
+  fill(doc);
+  if (doc.overflowed() || measureJson(doc) >= maxLen) return "";
+  serializeJson(doc, out, maxLen);
+  return out;
+}
+
+// RAM cao điểm mỗi request = FreeHeap trước request − FreeHeap thấp nhất lúc response còn trong RAM
+// (document đã parse). Bỏ qua request có handshake: buffer TLS (~40KB) không liên quan cách parse
+uint32_t reqHeapBase = 0, reqHeapLow = 0, reqHeapHandshakes = 0;
+volatile uint32_t g_reqHeapLast = 0, g_reqHeapMax = 0;
+
+void reqHeapBegin() { reqHeapBase = reqHeapLow = hal::freeHeap(); reqHeapHandshakes = hal::httpStats().handshakes; }
+void reqHeapMark() { uint32_t f = hal::freeHeap(); if (f < reqHeapLow) reqHeapLow = f; }
+void reqHeapEnd() {
+  if (hal::httpStats().handshakes != reqHeapHandshakes) return;
+  g_reqHeapLast = reqHeapBase - reqHeapLow;
+  if (g_reqHeapLast > g_reqHeapMax) g_reqHeapMax = g_reqHeapLast;
+}
+
+// Response JSON đọc theo luồng từ socket (hal::HttpBodyReader): chỉ giữ field có trong filter,
+// không có String chứa cả body. doc = nullptr → bỏ body khi thành công; mã lỗi thì in đầu body
+struct JsonReply {
+  JsonDocument* doc;
+  JsonDocument* filter;
+  bool parsed;
+};
+
+void readJsonReply(int code, Stream& body, void* ctx) {
+  JsonReply& reply = *(JsonReply*)ctx;
+  if (code >= 200 && code < 300) {
+    if (!reply.doc) return;
+    DeserializationError err = deserializeJson(*reply.doc, body, DeserializationOption::Filter(*reply.filter));
+    reqHeapMark();
+    reply.parsed = !err;
+    if (err) serialPrintf("❌ JSON parse lỗi: %s\n", err.c_str());
+    return;
+  }
+  if (code == 401 || code == 404) return;   // nơi gọi tự log
+  char head[201];
+  size_t n = body.readBytes(head, sizeof(head) - 1);
+  head[n] = 0;
+  if (n) serialPrintf("⚠️ HTTP %d: %s\n", code, head);
+}
+
+// Filter response check-in/check-out/slot-event: chỉ id, user_id và timestamp (bỏ slot, user, ...)
+void historyReplyFilter(JsonDocument& f) {
+  static const char* const KEYS[] = {"id", "check_in_time", "checkInTime", "check_in_at", "checkInAt",
+                                     "check_out_time", "checkOutTime", "check_out_at", "checkOutAt"};
+  for (const char* k : KEYS) { f[k] = true; f["data"][k] = true; f["data"]["history"][k] = true; }
+  f["data"]["history"]["user_id"] = true;
+  f["data"]["user"]["id"] = true;
+  f["data"]["userId"] = true;
+  f["userId"] = true;
+}
+
 // ================== AUTH ==================
-bool loginAndGetToken() {
-  HTTPClient https; https.useHTTP10(true); https.setTimeout(HTTP_TIMEOUT_MS); https.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-  String url = buildUrl(LOGIN_PATH);
-  if (!httpBegin(https, url)) { Serial.println("❌ begin() login fail"); return false; }
+// Payload JWT là base64url; decode tại chỗ vào out (đủ len*3/4 byte), trả số byte
+static size_t base64UrlDecode(const char* in, size_t len, char* out) {
+  size_t n = 0;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = in[i];
+    int v = c >= 'A' && c <= 'Z' ? c - 'A' : c >= 'a' && c <= 'z' ? c - 'a' + 26 :
+            c >= '0' && c <= '9' ? c - '0' + 52 : c == '-' || c == '+' ? 62 : c == '_' || c == '/' ? 63 : -1;
+    if (v < 0) break;   // '=' hoặc ký tự lạ: hết dữ liệu
+    acc = (acc << 6) | v; bits += 6;
+    if (bits >= 8) { bits -= 8; out[n++] = (char)(acc >> bits); }
+  }
+  return n;
+}
 
-  StaticJsonDocument<256> body; body["email"] = LOGIN_EMAIL; body["password"] = LOGIN_PASSWORD;
-  String json; serializeJson(body, json);
-  https.addHeader("Content-Type", "application/json"); addCommonHeaders(https);
+// Thời hạn token = exp - iat (giây → ms). Board không có đồng hồ thật nên tính từ lúc nhận token,
+// không so exp với giờ hiện tại. 0: không phải JWT / thiếu claim
+uint32_t jwtLifetimeMs(const char* token) {
+  const char* payload = strchr(token, '.');
+  const char* end = payload ? strchr(payload + 1, '.') : nullptr;
+  if (!end) return 0;
+  ScratchScope scope;
+  size_t len = end - payload - 1;
+  char* json = (char*)scratch::alloc(len * 3 / 4 + 1);
+  if (!json) return 0;
+  size_t n = base64UrlDecode(payload + 1, len, json);
+
+  JsonDocument filter(scratch::json());
+  filter["exp"] = true; filter["iat"] = true;
+  JsonDocument doc(scratch::json());
+  if (deserializeJson(doc, json, n, DeserializationOption::Filter(filter))) return 0;
+  long long exp = doc["exp"].as<long long>(), iat = doc["iat"].as<long long>();
+  if (iat <= 0 || exp <= iat) return 0;
+  long long ms = (exp - iat) * 1000;
+  return ms < 0x40000000LL ? (uint32_t)ms : 0x40000000u;   // tối đa ~12 ngày để phép trừ millis() không tràn
+}
 
-  int code = https.POST(json);
-  if (code <= 0) { Serial.printf("❌ Login HTTP error: %s (%d)\n", https.errorToString(code).c_str(), code); https.end(); return false; }
+bool loginAndGetToken() {
+  LatencySpan span(latency::LOGIN);
+  uint32_t start = hal::millis();
+  ScratchScope scope;
+  const char* json = jsonBody(96, [](JsonDocument& body) { body["email"] = LOGIN_EMAIL; body["password"] = LOGIN_PASSWORD; });
+
+  JsonDocument filter(scratch::json());
+  filter["data"]["token"] = true; filter["token"] = true; filter["access_token"] = true;
+  JsonDocument doc(scratch::json());
+  JsonReply reply = {&doc, &filter, false};
+  reqHeapBegin();
+  int code = hal::httpRequest({"POST", buildUrl(LOGIN_PATH), json, AUTH_TOKEN, nullptr}, readJsonReply, &reply);
+  reqHeapEnd();
+  g_authMs += hal::millis() - start;
+  if (code <= 0) {
+    g_authFailures++;
+    serialPrintf("❌ Login HTTP error: %s (%d)\n", hal::httpErrorToString(code), code);
+    return false;
+  }
 
+  // Parse ra biến tạm: 200 mà không có token thì giữ token cũ nhưng không tính là login thành công
+  // (không dời g_tokenIssuedMs → lịch refresh vẫn theo token sắp hết hạn)
   bool ok = false;
-  if (code == 200) {
-    DynamicJsonDocument doc(2048);
-    auto err = deserializeJson(doc, https.getString());
-    if (!err) {
-      if (doc["data"]["token"].is<String>())      AUTH_TOKEN = doc["data"]["token"].as<String>();
-      else if (doc["token"].is<String>())         AUTH_TOKEN = doc["token"].as<String>();
-      else if (doc["access_token"].is<String>())  AUTH_TOKEN = doc["access_token"].as<String>();
-      ok = AUTH_TOKEN.length() > 0;
-    }
-  } else {
-    Serial.printf("⚠️ Login code=%d: %s\n", code, https.getString().c_str());
+  AuthTokenStr token;
+  if (code == 200 && reply.parsed) {
+    ok = firstValue(token, {doc["data"]["token"], doc["token"], doc["access_token"]}) && token[0];
+    if (ok) copyField(AUTH_TOKEN, token);
+  } else if (code != 200) {
+    serialPrintf("⚠️ Login code=%d\n", code);
   }
-  https.end();
-  Serial.println(ok ? "✅ Lấy token OK" : "❌ Lấy token FAIL");
-  return ok;
+  if (!ok) { g_authFailures++; Serial.println("❌ Lấy token FAIL"); return false; }
+  g_authLogins++;
+  g_tokenIssuedMs = hal::millis();
+  g_tokenLifetimeMs = jwtLifetimeMs(AUTH_TOKEN);
+  g_authRetryAt = g_tokenIssuedMs;
+  if (g_tokenLifetimeMs) serialPrintf("✅ Lấy token OK (hạn %lu s)\n", (unsigned long)(g_tokenLifetimeMs / 1000));
+  else Serial.println("✅ Lấy token OK (không đọc được exp → chỉ refresh khi 401)");
+  return true;
+}
+bool ensureAuth() { if (AUTH_TOKEN[0]) return true; Serial.println("ℹ️ Chưa có token → login()"); return loginAndGetToken(); }
+
+// Thời gian tới lần refresh chủ động (0 = ngay), WAIT_FOREVER nếu token không có exp.
+// Chưa có token (WiFi hỏng lúc boot) cũng login ngay → xe đầu tiên không phải chờ login
+uint32_t authWaitMs() {
+  if (AUTH_TOKEN[0] && !g_tokenLifetimeMs) return hal::WAIT_FOREVER;
+  uint32_t now = hal::millis();
+  uint32_t due = g_tokenIssuedMs + g_tokenLifetimeMs - g_tokenLifetimeMs / TOKEN_REFRESH_DIV;
+  if (!AUTH_TOKEN[0]) due = now;
+  if ((int32_t)(g_authRetryAt - due) > 0) due = g_authRetryAt;
+  int32_t wait = (int32_t)(due - now);
+  return wait > 0 ? (uint32_t)wait : 0;
+}
+
+void refreshToken() {
+  if (!hal::wifiConnected()) { g_authRetryAt = hal::millis() + WIFI_POLL_MS; return; }
+  Serial.println(AUTH_TOKEN[0] ? "🔑 Token sắp hết hạn → login lại (nền)" : "🔑 Chưa có token → login (nền)");
+  bool had = AUTH_TOKEN[0] != 0;
+  if (loginAndGetToken()) { if (had) g_authProactive++; return; }
+  g_authRetryAt = hal::millis() + TOKEN_RETRY_MS;
 }
-bool ensureAuth() { if (AUTH_TOKEN.length() > 0) return true; Serial.println("ℹ️ Chưa có token → login()"); return loginAndGetToken(); }
 
 // ================== HTTP helper (retry + refresh 401) ==================
-bool doHttpWithRetry(std::function<int(HTTPClient&)> fnDo, const String& url, int& outCode, String& outPayload) {
+// body "" → không gửi body; AUTH_TOKEN đọc lại mỗi lần thử (có thể vừa refresh, login dùng
+// ScratchScope riêng nên url/body/document của nơi gọi vẫn còn).
+// reply: response đọc theo luồng (doc = nullptr → chỉ cần mã)
+bool doHttpWithRetry(const char* method, const char* url, const char* body, int& outCode, JsonReply& reply) {
   for (uint8_t attempt = 0; attempt < MAX_HTTP_RETRIES; attempt++) {
-    HTTPClient https; https.useHTTP10(true); https.setTimeout(HTTP_TIMEOUT_MS); https.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    if (!httpBegin(https, url)) { Serial.println("❌ begin() fail"); return false; }
-    addCommonHeaders(https);
-
-    outCode = fnDo(https);
-    outPayload = https.getString();
-    https.end();
+    reqHeapBegin();
+    outCode = hal::httpRequest({method, url, body, AUTH_TOKEN, nullptr}, readJsonReply, &reply);
+    reqHeapEnd();
 
     if (outCode == 401) {
-      if (g_authRetry < MAX_AUTH_RETRIES && loginAndGetToken()) { g_authRetry++; continue; }
+      plateCacheClear();   // token/tài khoản đổi phía server → không tin dữ liệu cũ
+      if (g_authRetry < MAX_AUTH_RETRIES && loginAndGetToken()) { g_authRetry++; g_authOn401++; continue; }
       return false;
     }
     g_authRetry = 0;
@@ -189,54 +504,43 @@ bool doHttpWithRetry(std::function<int(HTTPClient&)> fnDo, const String& url, in
 
 // ================== SUPABASE FALLBACK (tuỳ chọn) ==================
 #if USE_SUPABASE_FALLBACK
-bool supaInsertCheckin(const String& userId, int slotId, const String& plate, String& outHistoryId, String& outCheckInAt) {
-  String url = String(SUPA_URL) + "/rest/v1/parking_history";
-  HTTPClient http; http.useHTTP10(true); http.setTimeout(HTTP_TIMEOUT_MS);
-  if (!httpBegin(http, url)) return false;
-  http.addHeader("apikey", SUPA_KEY);
-  http.addHeader("Authorization", String("Bearer ") + SUPA_KEY);
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Prefer", "return=representation");
-
-  StaticJsonDocument<256> body;
-  body["slot_id"] = slotId; body["user_id"] = userId; body["license_plate"] = plate;
-  String json; serializeJson(body, json);
-
-  int code = http.POST(json);
-  String payload = http.getString(); http.end();
-
-  if (code == 201) {
-    DynamicJsonDocument doc(1024);
-    if (!deserializeJson(doc, payload)) {
-      outHistoryId = String((long long)doc[0]["id"].as<long long>());
-      outCheckInAt = parseTimestamp(doc[0], "check_in_time", "checkInTime", "check_in_at", "checkInAt");
-      return outHistoryId.length() > 0;
-    }
+const char* const SUPA_HEADERS[] = {"apikey", SUPA_KEY, "Prefer", "return=representation", nullptr};
+
+// PostgREST trả mảng bản ghi → filter phần tử đầu
+bool supaInsertCheckin(const char* userId, int slotId, const char* plate, HistoryIdStr& outHistoryId, TimeStr& outCheckInAt) {
+  ScratchScope scope;
+  const char* url = scratch::format("%s/rest/v1/parking_history", SUPA_URL);
+  const char* json = jsonBody(160, [&](JsonDocument& body) {
+    body["slot_id"] = slotId; body["user_id"] = userId; body["license_plate"] = plate;
+  });
+
+  JsonDocument filter(scratch::json());
+  filter[0]["id"] = true;
+  for (const char* k : {"check_in_time", "checkInTime", "check_in_at", "checkInAt"}) filter[0][k] = true;
+  JsonDocument doc(scratch::json());
+  JsonReply reply = {&doc, &filter, false};
+  int code = hal::httpRequest({"POST", url, json, SUPA_KEY, SUPA_HEADERS}, readJsonReply, &reply);
+
+  if (code == 201 && reply.parsed && firstValue(outHistoryId, {doc[0]["id"]})) {
+    copyField(outCheckInAt, parseTimestamp(doc[0], "check_in_time", "checkInTime", "check_in_at", "checkInAt"));
+    return true;
   }
   return false;
 }
-bool supaUpdateCheckout(const String& historyId, String& outCheckOutAt) {
-  String url = String(SUPA_URL) + "/rest/v1/parking_history?id=eq." + historyId;
-  HTTPClient http; http.useHTTP10(true); http.setTimeout(HTTP_TIMEOUT_MS);
-  if (!httpBegin(http, url)) return false;
-  http.addHeader("apikey", SUPA_KEY);
-  http.addHeader("Authorization", String("Bearer ") + SUPA_KEY);
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Prefer", "return=representation");
-
-  StaticJsonDocument<128> body;
-  body["check_out_time"] = "now()";
-  String json; serializeJson(body, json);
-
-  int code = http.PATCH(json);
-  String payload = http.getString(); http.end();
-
-  if (code == 200) {
-    DynamicJsonDocument doc(512);
-    if (!deserializeJson(doc, payload)) {
-      outCheckOutAt = parseTimestamp(doc[0], "check_out_time", "checkOutTime", "check_out_at", "checkOutAt");
-      return outCheckOutAt.length() > 0;
-    }
+bool supaUpdateCheckout(const char* historyId, TimeStr& outCheckOutAt) {
+  ScratchScope scope;
+  const char* url = scratch::format("%s/rest/v1/parking_history?id=eq.%s", SUPA_URL, historyId);
+  const char* json = jsonBody(48, [](JsonDocument& body) { body["check_out_time"] = "now()"; });
+
+  JsonDocument filter(scratch::json());
+  for (const char* k : {"check_out_time", "checkOutTime", "check_out_at", "checkOutAt"}) filter[0][k] = true;
+  JsonDocument doc(scratch::json());
+  JsonReply reply = {&doc, &filter, false};
+  int code = hal::httpRequest({"PATCH", url, json, SUPA_KEY, SUPA_HEADERS}, readJsonReply, &reply);
+
+  if (code == 200 && reply.parsed) {
+    copyField(outCheckOutAt, parseTimestamp(doc[0], "check_out_time", "checkOutTime", "check_out_at", "checkOutAt"));
+    return outCheckOutAt[0] != 0;
   }
   return false;
 }
@@ -244,389 +548,896 @@ bool supaUpdateCheckout(const String& historyId, String& outCheckOutAt) {
 
 // ================== API LAYER ==================
 
-// Tra user theo biển số — trả "" nếu không tìm thấy
-String fetchUserIdByPlate(String plate) {
-  if (!ensureAuth()) return "";
-
-  String url = String(BASE_URL) + String(FIND_PLATE_PATH) + urlEncode(plate);
-  int code = -1; String payload;
-  bool ok = doHttpWithRetry([&](HTTPClient& https){ return https.GET(); }, url, code, payload);
-  if (!ok) { Serial.println("❌ GET plate fail"); return ""; }
-
-  Serial.printf("🌐 GET plate code: %d\n", code);
+// Tra user theo biển số → outUserId ("" nếu không tìm thấy)
+void fetchUserIdByPlate(const char* plate, UserIdStr& outUserId) {
+  LatencySpan span(latency::PLATE);
+  if (plateCacheGet(plate, outUserId)) {
+    serialPrintf("⚡ Cache biển số: %s → %s\n", plate, outUserId[0] ? outUserId : "(chưa đăng ký)");
+    return;
+  }
+  outUserId[0] = 0;
+  if (!ensureAuth()) return;
+
+  ScratchScope scope;
+  const char* url = scratch::format("%s%s%s", BASE_URL, FIND_PLATE_PATH, urlEncode(plate));
+  JsonDocument filter(scratch::json());
+  filter["data"]["id"] = true; filter["data"]["userId"] = true; filter["data"]["user"]["id"] = true;
+  filter["id"] = true; filter["userId"] = true; filter["user"]["id"] = true;
+  JsonDocument doc(scratch::json());
+  JsonReply reply = {&doc, &filter, false};
+  int code = -1;
+  bool ok = doHttpWithRetry("GET", url, "", code, reply);
+  if (!ok) { Serial.println("❌ GET plate fail"); return; }
+
+  serialPrintf("🌐 GET plate code: %d\n", code);
   if (code == 200) {
-    DynamicJsonDocument doc(4096);
-    if (!deserializeJson(doc, payload)) {
-      String userId = "";
-
-      if (doc["data"]["id"].is<String>())                  userId = doc["data"]["id"].as<String>();
-      else if (doc["id"].is<String>())                     userId = doc["id"].as<String>();
-      else if (doc["data"]["user"]["id"].is<String>())     userId = doc["data"]["user"]["id"].as<String>();
-      else if (doc["user"]["id"].is<String>())             userId = doc["user"]["id"].as<String>();
-      else if (doc["data"]["userId"].is<String>())         userId = doc["data"]["userId"].as<String>();
-      else if (doc["userId"].is<String>())                 userId = doc["userId"].as<String>();
-      else if (doc["data"]["id"].is<long long>())          userId = String(doc["data"]["id"].as<long long>());
-      else if (doc["id"].is<long long>())                  userId = String(doc["id"].as<long long>());
-      else if (doc["data"]["user"]["id"].is<long long>())  userId = String(doc["data"]["user"]["id"].as<long long>());
-      else if (doc["user"]["id"].is<long long>())          userId = String(doc["user"]["id"].as<long long>());
-      else if (doc["data"]["userId"].is<long long>())      userId = String(doc["data"]["userId"].as<long long>());
-      else if (doc["userId"].is<long long>())              userId = String(doc["userId"].as<long long>());
-
-      userId.trim();
-      if (userId.length() > 0 && userId != "null") {
-        Serial.println("✅ Tìm thấy userId: " + userId + " cho plate: " + plate);
-        return userId;
+    if (reply.parsed) {
+      firstValue(outUserId, {doc["data"]["id"], doc["id"], doc["data"]["user"]["id"], doc["user"]["id"],
+                             doc["data"]["userId"], doc["userId"]});
+      if (hasValue(outUserId)) {
+        serialPrintf("✅ Tìm thấy userId: %s cho plate: %s\n", outUserId, plate);
+        plateCachePut(plate, outUserId);
       } else {
-        Serial.println("⛔ Không tìm thấy userId trong payload cho plate: " + plate);
-        return "";
+        serialPrintf("⛔ Không tìm thấy userId trong payload cho plate: %s\n", plate);
+        outUserId[0] = 0;
+        plateCachePut(plate, "");
       }
     } else {
       Serial.println("❌ JSON parse lỗi khi tìm userId theo plate");
-      return "";
     }
   } else if (code == 404) {
-    Serial.println("ℹ️ Plate không tồn tại (404): " + plate);
-    return "";
+    serialPrintf("ℹ️ Plate không tồn tại (404): %s\n", plate);
+    plateCachePut(plate, "");
   } else {
-    Serial.printf("⚠️ GET plate code=%d payload=%s\n", code, payload.c_str());
-    return "";
+    serialPrintf("⚠️ GET plate code=%d\n", code);
   }
 }
 
+// Node chứa timestamp: data.history, data, hoặc gốc
+JsonVariant historyNode(JsonDocument& doc) {
+  if (!doc["data"]["history"].isNull()) return doc["data"]["history"];
+  if (!doc["data"].isNull())            return doc["data"];
+  return doc.as<JsonVariant>();
+}
+
+// Đọc response check-in (POST /checkin hoặc slot-event "in"): historyId, giờ vào, user_id server đã ghi
+// doc đã lọc bằng historyReplyFilter()
+bool parseCheckInResponse(JsonDocument& doc, HistoryIdStr& outHistoryId, TimeStr& outCheckInAt, UserIdStr* outResolvedUserId) {
+  // historyId (ưu tiên data.history.id)
+  outHistoryId[0] = 0;
+  firstValue(outHistoryId, {doc["data"]["history"]["id"], doc["data"]["id"], doc["id"]});
+
+  copyField(outCheckInAt, parseTimestamp(historyNode(doc), "check_in_time", "checkInTime", "check_in_at", "checkInAt"));
+
+  // ✅ ƯU TIÊN user_id từ history (đúng như server đã ghi), fallback nếu API không trả trong history
+  if (outResolvedUserId) {
+    UserIdStr resolved = "";
+    firstValue(resolved, {doc["data"]["history"]["user_id"]});
+    if (!hasValue(resolved)) firstValue(resolved, {doc["data"]["user"]["id"], doc["data"]["userId"], doc["userId"]});
+    if (hasValue(resolved)) {
+      copyField(*outResolvedUserId, resolved);
+      serialPrintf("✅ Server user_id (history.user_id): %s\n", resolved);
+    }
+  }
+
+  bool success = hasValue(outHistoryId);
+  if (!success) serialPrintf("❌ Lỗi: historyId không hợp lệ: %s\n", outHistoryId);
+  return success;
+}
+
 // Check-in linh hoạt: có userId thì gửi; không có vẫn check-in với plate+slotId.
 // Luôn cố gắng lấy lại user_id từ server (ưu tiên data.history.user_id).
-bool apiCheckIn(const String& userIdMaybeEmpty,
-                const String& plate,
+bool apiCheckIn(const char* userIdMaybeEmpty,
+                const char* plate,
                 int slotId,
-                String& outHistoryId,
-                String& outCheckInAt,
-                String* outResolvedUserId /* có thể nullptr */) {
+                HistoryIdStr& outHistoryId,
+                TimeStr& outCheckInAt,
+                UserIdStr* outResolvedUserId /* có thể nullptr */,
+                int& outCode) {
+  LatencySpan span(latency::CHECKIN);
+  outCode = -1;
   if (!ensureAuth()) return false;
-  String url = buildUrl(CHECKIN_PATH);
-
-  int code=-1; String payload;
-  bool ok = doHttpWithRetry([&](HTTPClient& https){
-    https.addHeader("Content-Type", "application/json");
-    StaticJsonDocument<384> body;
-
+  ScratchScope scope;
+  const char* json = jsonBody(256, [&](JsonDocument& body) {
     body["slot_id"]       = slotId;
     body["slotId"]        = slotId;
     body["license_plate"] = plate;
     body["licensePlate"]  = plate;
-
-    String trimmed = userIdMaybeEmpty; trimmed.trim();
-    if (trimmed.length() > 0 && trimmed != "null") {
-      body["user_id"] = trimmed;
-      body["userId"]  = trimmed;
+    if (hasValue(userIdMaybeEmpty)) {
+      body["user_id"] = userIdMaybeEmpty;
+      body["userId"]  = userIdMaybeEmpty;
     }
+  });
+  Serial.print("➡️ CHECK-IN Body: "); Serial.println(json);
 
-    String json; serializeJson(body, json);
-    Serial.println("➡️ CHECK-IN Body: " + json);
-    return https.POST(json);
-  }, url, code, payload);
-
-  Serial.printf("📝 CHECK-IN slot %d → %d\n", slotId, code);
-
-  if (ok && (code==200 || code==201)) {
-    DynamicJsonDocument doc(8192);
-    if (!deserializeJson(doc, payload)) {
-
-      // historyId (ưu tiên data.history.id)
-      if (doc["data"]["history"]["id"].is<long long>())      outHistoryId = String(doc["data"]["history"]["id"].as<long long>());
-      else if (doc["data"]["history"]["id"].is<String>())    outHistoryId = doc["data"]["history"]["id"].as<String>();
-      else if (doc["data"]["id"].is<long long>())            outHistoryId = String(doc["data"]["id"].as<long long>());
-      else if (doc["data"]["id"].is<String>())               outHistoryId = doc["data"]["id"].as<String>();
-      else if (doc["id"].is<long long>())                    outHistoryId = String(doc["id"].as<long long>());
-      else if (doc["id"].is<String>())                       outHistoryId = doc["id"].as<String>();
-
-      // timestamp
-      JsonVariant dataNode;
-      if (!doc["data"]["history"].isNull()) dataNode = doc["data"]["history"];
-      else if (!doc["data"].isNull())       dataNode = doc["data"];
-      else                                  dataNode = doc.as<JsonVariant>();
-      outCheckInAt = parseTimestamp(dataNode, "check_in_time", "checkInTime", "check_in_at", "checkInAt");
-
-      // ✅ ƯU TIÊN user_id từ history (đúng như server đã ghi)
-      if (outResolvedUserId) {
-        String resolved = "";
-        if (doc["data"]["history"]["user_id"].is<String>())         resolved = doc["data"]["history"]["user_id"].as<String>();
-        else if (doc["data"]["history"]["user_id"].is<long long>()) resolved = String(doc["data"]["history"]["user_id"].as<long long>());
-
-        // fallback nếu API không trả trong history
-        if (resolved.length() == 0 || resolved == "null") {
-          if (doc["data"]["user"]["id"].is<String>())               resolved = doc["data"]["user"]["id"].as<String>();
-          else if (doc["data"]["userId"].is<String>())              resolved = doc["data"]["userId"].as<String>();
-          else if (doc["userId"].is<String>())                      resolved = doc["userId"].as<String>();
-          else if (doc["data"]["user"]["id"].is<long long>())       resolved = String(doc["data"]["user"]["id"].as<long long>());
-          else if (doc["data"]["userId"].is<long long>())           resolved = String(doc["data"]["userId"].as<long long>());
-          else if (doc["userId"].is<long long>())                   resolved = String(doc["userId"].as<long long>());
-        }
-        resolved.trim();
-        if (resolved.length() > 0 && resolved != "null") {
-          *outResolvedUserId = resolved;
-          Serial.println("✅ Server user_id (history.user_id): " + resolved);
-        }
-      }
+  JsonDocument filter(scratch::json()); historyReplyFilter(filter);
+  JsonDocument doc(scratch::json());
+  JsonReply reply = {&doc, &filter, false};
+  int& code = outCode;
+  bool ok = doHttpWithRetry("POST", buildUrl(CHECKIN_PATH), json, code, reply);
 
-      bool success = outHistoryId.length() > 0 && outHistoryId != "null";
-      if (!success) Serial.println("❌ Lỗi: historyId không hợp lệ: " + outHistoryId);
-      return success;
-    }
-  }
+  serialPrintf("📝 CHECK-IN slot %d → %d\n", slotId, code);
 
-  if (payload.length()) Serial.println(payload);
+  if (ok && (code==200 || code==201) && reply.parsed && parseCheckInResponse(doc, outHistoryId, outCheckInAt, outResolvedUserId)) return true;
   return false;
 }
 
+// Đọc giờ ra từ response check-out (POST /checkout hoặc slot-event "out")
+bool parseCheckOutResponse(JsonDocument& doc, TimeStr& outCheckOutAt) {
+  copyField(outCheckOutAt, parseTimestamp(historyNode(doc), "check_out_time", "checkOutTime", "check_out_at", "checkOutAt"));
+  serialPrintf("🕒 Parsed check-out time: %s\n", outCheckOutAt);
+  return outCheckOutAt[0] != 0;
+}
+
 // Check-out
-bool apiCheckOut(const String& historyId, String& outCheckOutAt) {
+bool apiCheckOut(const char* historyId, TimeStr& outCheckOutAt, int& outCode) {
+  LatencySpan span(latency::CHECKOUT);
+  outCode = -1;
   if (!ensureAuth()) return false;
-  String url = buildUrl(CHECKOUT_PATH);
-
-  int code=-1; String payload;
-  bool ok = doHttpWithRetry([&](HTTPClient& https){
-    https.addHeader("Content-Type", "application/json");
-    StaticJsonDocument<192> body;
+  ScratchScope scope;
+  const char* json = jsonBody(96, [&](JsonDocument& body) {
     body["history_id"] = historyId;
     body["id"]         = historyId;
-    String json; serializeJson(body, json);
-    Serial.println("➡️ CHECK-OUT Body: " + json);
-    return https.POST(json);
-  }, url, code, payload);
-
-  Serial.printf("🧾 CHECK-OUT history=%s → %d\n", historyId.c_str(), code);
-
-  if (ok && code==200) {
-    DynamicJsonDocument doc(8192);
-    if (!deserializeJson(doc, payload)) {
-      JsonVariant dataNode;
-      if (!doc["data"]["history"].isNull()) dataNode = doc["data"]["history"];
-      else if (!doc["data"].isNull())       dataNode = doc["data"];
-      else                                  dataNode = doc.as<JsonVariant>();
-      outCheckOutAt = parseTimestamp(dataNode, "check_out_time", "checkOutTime", "check_out_at", "checkOutAt");
-      Serial.println("🕒 Parsed check-out time: " + outCheckOutAt);
-      return outCheckOutAt.length()>0;
-    }
-  }
+  });
+  Serial.print("➡️ CHECK-OUT Body: "); Serial.println(json);
+
+  JsonDocument filter(scratch::json()); historyReplyFilter(filter);
+  JsonDocument doc(scratch::json());
+  JsonReply reply = {&doc, &filter, false};
+  int& code = outCode;
+  bool ok = doHttpWithRetry("POST", buildUrl(CHECKOUT_PATH), json, code, reply);
+
+  serialPrintf("🧾 CHECK-OUT history=%s → %d\n", historyId, code);
+
+  if (ok && code==200 && reply.parsed && parseCheckOutResponse(doc, outCheckOutAt)) return true;
 #if USE_SUPABASE_FALLBACK
   if (supaUpdateCheckout(historyId, outCheckOutAt)) return true;
 #endif
-  if (payload.length()) Serial.println(payload);
   return false;
 }
 
 // Update slot status API
-bool putSlotStatus(int slotId, const String& status) {
+bool putSlotStatus(int slotId, const char* status) {
+  LatencySpan span(latency::STATUS);
   if (!ensureAuth()) return false;
+  ScratchScope scope;
   char path[128]; snprintf(path, sizeof(path), SLOT_STATUS_PUT_FMT, slotId);
-  String url = buildUrl(path);
-  int code=-1; String payload;
-  bool ok = doHttpWithRetry([&](HTTPClient& https){
-    https.addHeader("Content-Type", "application/json");
-    StaticJsonDocument<128> body; body["status"]=status; String json; serializeJson(body, json);
-    Serial.println("➡️ PUT slot status: " + json);
-    return https.PUT(json);
-  }, url, code, payload);
-  Serial.printf("🔄 PUT slot %d status='%s' → %d\n", slotId, status.c_str(), code);
-  if (!ok || (code != 200 && code != 204)) {
-    if (payload.length()) Serial.println(payload);
-    return false;
+  const char* json = jsonBody(48, [&](JsonDocument& body) { body["status"] = status; });
+  serialPrintf("➡️ PUT slot status: %s\n", json);
+
+  JsonReply reply = {nullptr, nullptr, false};
+  int code=-1;
+  bool ok = doHttpWithRetry("PUT", buildUrl(path), json, code, reply);
+  serialPrintf("🔄 PUT slot %d status='%s' → %d\n", slotId, status, code);
+  if (!ok || (code != 200 && code != 204)) return false;
+  return true;
+}
+
+// Trạng thái nhiều slot trong 1 request; outCode = mã HTTP (404: server chưa có route)
+bool putSlotStatuses(const char* const* statuses, int& outCode) {
+  LatencySpan span(latency::STATUS);
+  outCode = -1;
+  if (!ensureAuth()) return false;
+  ScratchScope scope;
+  // {"id":NN,"status":"available"} ≤ 40 ký tự mỗi slot
+  size_t cap = 16 + NUM_SLOTS * 40;
+  char* json = (char*)scratch::alloc(cap);
+  if (!json) return false;
+  size_t len = snprintf(json, cap, "{\"slots\":[");
+  int n = 0;
+  for (int i = 0; i < NUM_SLOTS; i++) {
+    if (!statuses[i]) continue;
+    len += snprintf(json + len, cap - len, "%s{\"id\":%d,\"status\":\"%s\"}", n++ ? "," : "", i + 1, statuses[i]);
   }
+  snprintf(json + len, cap - len, "]}");
+  Serial.print("➡️ PUT slot status (lô): "); Serial.println(json);
+
+  JsonReply reply = {nullptr, nullptr, false};
+  bool ok = doHttpWithRetry("PUT", buildUrl(SLOT_STATUS_BULK_PATH), json, outCode, reply);
+  serialPrintf("🔄 PUT %d slot status → %d\n", n, outCode);
+  if (!ok || (outCode != 200 && outCode != 204)) return false;
   return true;
 }
 
+#if USE_SLOT_EVENT
+// Slot event: direction "in" → server tra biển số + ghi lịch sử + slot occupied;
+// "out" → đóng phiên (historyId, hoặc phiên đang mở của slot) + slot available.
+// Response cùng dạng /checkin, /checkout → dùng lại parseCheckInResponse/parseCheckOutResponse
+// eventId: idempotency key (gửi lại sau timeout/reset không ghi trùng); ageMs = NO_EVENT_AGE nếu
+// sự kiện từ lần khởi động trước (millis() đã reset) → server lấy giờ nhận
+const uint32_t NO_EVENT_AGE = 0xFFFFFFFFu;
+
+bool apiSlotEvent(bool in, int slotId, const char* plate, const char* historyId, const char* eventId,
+                  uint32_t ageMs, HistoryIdStr& outHistoryId, TimeStr& outAt, UserIdStr* outResolvedUserId, int& outCode) {
+  LatencySpan span(latency::EVENT);
+  outCode = -1;
+  if (!ensureAuth()) return false;
+  ScratchScope scope;
+  const char* json = jsonBody(192, [&](JsonDocument& body) {
+    body["slot_id"]   = slotId;
+    body["direction"] = in ? "in" : "out";
+    if (plate[0]) body["license_plate"] = plate;
+    if (!in && hasValue(historyId)) body["history_id"] = historyId;
+    if (eventId[0]) body["event_id"] = eventId;
+    if (ageMs != NO_EVENT_AGE) body["age_ms"] = ageMs;
+  });
+  Serial.print("➡️ SLOT EVENT Body: "); Serial.println(json);
+
+  JsonDocument filter(scratch::json()); historyReplyFilter(filter);
+  JsonDocument doc(scratch::json());
+  JsonReply reply = {&doc, &filter, false};
+  bool ok = doHttpWithRetry("POST", buildUrl(SLOT_EVENT_PATH), json, outCode, reply) && reply.parsed;
+  serialPrintf("📮 SLOT EVENT slot %d %s → %d\n", slotId, in ? "in" : "out", outCode);
+
+  if (ok && in && (outCode==200 || outCode==201) && parseCheckInResponse(doc, outHistoryId, outAt, outResolvedUserId)) return true;
+  if (ok && !in && outCode==200 && parseCheckOutResponse(doc, outAt)) return true;
+  return false;
+}
+#endif
+
 // ================== PHẦN CỨNG ==================
-float readDistanceCM(int trigPin, int echoPin) {
-  digitalWrite(trigPin, LOW); delayMicroseconds(2);
-  digitalWrite(trigPin, HIGH); delayMicroseconds(10);
-  digitalWrite(trigPin, LOW);
-  long duration = pulseIn(echoPin, HIGH, ULTRA_TIMEOUT_US);
-  float distance = duration * 0.034f / 2.0f;
-  if (distance <= 0 || distance > 400) distance = 400;
-  return distance;
-}
-
-void printStatus() {
-  Serial.println("\n📋 ====== TRẠNG THÁI HIỆN TẠI ======");
-  Serial.println("+-----+-------------+-----------+-------------+--------------------------------------+---------------------+---------------------+");
-  Serial.println("| Slot| Khoảng cách | Trạng thái|   Biển số   |                UserID               |     Check-in at     |    Check-out at     |");
-  Serial.println("+-----+-------------+-----------+-------------+--------------------------------------+---------------------+---------------------+");
+// Gọi mỗi vòng loop(): thu echo đã xong (ngắt GPIO bắt sẵn), hết lượt thì trigger lượt kế.
+// Không chờ echo → thời gian mỗi lần gọi không phụ thuộc NUM_SLOTS hay khoảng cách
+int rangingGroup = 0;
+unsigned long rangingWindowStart = 0;
+latency::Mark rangingFrom;
+bool rangingOpen = false;   // lượt hiện tại chưa về hết echo
+
+void rangingService() {
+  bool pending = false;
+  for (int i = rangingGroup; i < NUM_SLOTS; i += RANGING_STRIDE) {
+    uint32_t echoUs;
+    hal::EchoStatus st = hal::ultrasonicPoll(i, ULTRA_TIMEOUT_US, echoUs);
+    if (st == hal::ECHO_READY) { slots[i].distance = echoToCM(echoUs); slots[i].fresh = true; }
+    else if (st == hal::ECHO_PENDING) pending = true;
+  }
+  if (!pending && rangingOpen) { latency::recordSince(latency::RANGE, rangingFrom); rangingOpen = false; }
+  unsigned long now = hal::millis();
+  if (pending || now - rangingWindowStart < RANGING_WINDOW_MS) return;
+
+  rangingGroup = (rangingGroup + 1) % RANGING_STRIDE;
+  rangingFrom = latency::mark();
+  rangingOpen = true;
+  for (int i = rangingGroup; i < NUM_SLOTS; i += RANGING_STRIDE) hal::ultrasonicStart(i);
+  rangingWindowStart = now;
+}
+
+// "850us" / "3.4ms" / "1520ms"
+int formatUs(char* out, size_t cap, uint32_t us) {
+  if (us < 1000)  return snprintf(out, cap, "%luus", (unsigned long)us);
+  if (us < 10000) return snprintf(out, cap, "%.1fms", us / 1000.0f);
+  return snprintf(out, cap, "%lums", (unsigned long)(us / 1000));
+}
+
+// Một dòng cho các stage [from, to) đã có số liệu: "tên n p50/p99/max"
+void printLatency(const char* label, latency::Stage from, latency::Stage to) {
+  char line[400];
+  size_t len = snprintf(line, sizeof(line), "%s (n p50/p99/max):", label);
+  int shown = 0;
+  for (int st = from; st < to && len < sizeof(line); st++) {
+    latency::Histogram h;
+    latency::snapshot((latency::Stage)st, h);
+    if (!h.count) continue;
+    len += snprintf(line + len, sizeof(line) - len, "%s %s %lu ", shown++ ? " |" : "",
+                    latency::stageName((latency::Stage)st), (unsigned long)h.count);
+    uint32_t values[3] = {latency::percentileUs(h, 500), latency::percentileUs(h, 990), h.maxUs};
+    for (int v = 0; v < 3 && len < sizeof(line); v++) {
+      if (v) line[len++] = '/';
+      if (len < sizeof(line)) len += formatUs(line + len, sizeof(line) - len, values[v]);
+    }
+  }
+  if (!shown) return;
+  Serial.println(line);
+}
+
+// Frame "@lat" (latency::frame) cho máy đọc: UDP mỗi lần gọi nếu cấu hình TELEMETRY_UDP_HOST,
+// Serial khi serial = true (cùng nhịp dòng tổng hợp của printStatus)
+void emitTelemetry(bool serial) {
+  static char frame[LATENCY_FRAME_BYTES];
+  size_t len = latency::frame(frame, sizeof(frame));
+  if (serial) Serial.println(frame);
+  if (TELEMETRY_UDP_HOST[0]) hal::udpSend(TELEMETRY_UDP_HOST, TELEMETRY_UDP_PORT, frame, len);
+}
+
+// ================== HIỂN THỊ TRẠNG THÁI ==================
+// Serial 115200 baud ~11,5KB/s và chặn loop() khi đầy FIFO → mỗi PRINT_INTERVAL_MS chỉ in dòng của
+// slot đã đổi (markRowDirty, hoặc khoảng cách lệch ≥ STATUS_DISTANCE_STEP_CM trong vùng có ý nghĩa
+// < clampCm); dòng tổng hợp khi có slot đổi hoặc mỗi STATUS_SUMMARY_INTERVAL_MS.
+// Cả bảng: gõ 's' trên Serial (serviceConsole) → chi phí in theo số thay đổi, không theo NUM_SLOTS
+static const float    STATUS_DISTANCE_STEP_CM    = 5.0f;
+static const uint32_t STATUS_SUMMARY_INTERVAL_MS = 60000;
+const char* const TABLE_RULE   = "+-----+-------------+-----------+-------------+--------------------------------------+---------------------+---------------------+";
+const char* const TABLE_HEADER = "| Slot| Khoảng cách | Trạng thái|   Biển số   |                UserID               |     Check-in at     |    Check-out at     |";
+
+bool rowDirty[NUM_SLOTS];        // chỉ loop() ghi/đọc
+float shownDistance[NUM_SLOTS];  // khoảng cách lúc in dòng gần nhất
+uint32_t lastSummaryAt = 0;
+bool summaryShown = false;
+
+void markRowDirty(int slotIdx) { rowDirty[slotIdx] = true; }
+
+bool rowChanged(int i) {
+  if (rowDirty[i]) return true;
+  float d = slots[i].distance, shown = shownDistance[i];
+  if (d >= SLOT_FILTER.clampCm && shown >= SLOT_FILTER.clampCm) return false;   // cùng là "xa"
+  return fabsf(d - shown) >= STATUS_DISTANCE_STEP_CM;
+}
+
+void printRow(int i) {
+  const char* status = slotFilter.occupied[i] ? "🚗 Có xe " : "🟢 Trống  ";
+  const char *plate = "-", *userId = "-", *inAt = "-", *outAt = "-";
+  if (const ParkedCar* pc = parkedAt(i)) {
+    plate  = pc->plate; userId = pc->historyId[0] ? pc->userId : "(chờ gửi server)";
+    if (pc->checkInAt[0])  inAt  = pc->checkInAt;    // %.19s: bỏ phần giây lẻ + múi giờ
+    if (pc->checkOutAt[0]) outAt = pc->checkOutAt;
+  }
+  char line[360];
+  snprintf(line, sizeof(line), "|  %-2d |   %6.1f cm | %-9s| %-11s| %-36s| %-19.19s | %-19.19s |",
+           i + 1, slots[i].distance, status, plate, userId, inAt, outAt);
+  Serial.println(line);
+  rowDirty[i] = false;
+  shownDistance[i] = slots[i].distance;
+}
+
+void printSummary() {
+  hal::HttpStats http = hal::httpStats();
+  uint32_t cacheHits = g_plateCacheHits, cacheLookups = cacheHits + g_plateCacheMisses;
+  serialPrintf("🅿️ Xe đang đậu: %d/%d | FreeHeap=%uB | TLS handshake %u/%u request (TB %u ms) | Journal chờ gửi %lu, bỏ %lu\n",
+               parkedCount, NUM_SLOTS, hal::freeHeap(), http.handshakes, http.requests,
+               http.handshakes ? http.handshakeMs / http.handshakes : 0,
+               (unsigned long)g_journalPending, (unsigned long)g_journalDropped);
+  serialPrintf("⚡ Cache biển số: hit %lu/%lu (%lu%%) | RAM/request: %luB (max %luB) | Scratch max %lu/%uB, hết chỗ %lu\n",
+               (unsigned long)cacheHits, (unsigned long)cacheLookups,
+               (unsigned long)(cacheLookups ? cacheHits * 100 / cacheLookups : 0),
+               (unsigned long)g_reqHeapLast, (unsigned long)g_reqHeapMax,
+               (unsigned long)scratch::peak(), (unsigned)SCRATCH_BYTES, (unsigned long)scratch::failures());
+  uint32_t tokenAgeMs = hal::millis() - g_tokenIssuedMs;
+  long tokenLeftS = g_tokenLifetimeMs && AUTH_TOKEN[0] ? ((long)g_tokenLifetimeMs - (long)tokenAgeMs) / 1000 : -1;
+  serialPrintf("🔑 Token còn %lds | login %lu (refresh trước hạn %lu, do 401 %lu, lỗi %lu), tổng %lu ms\n",
+               tokenLeftS, (unsigned long)g_authLogins, (unsigned long)g_authProactive,
+               (unsigned long)g_authOn401, (unsigned long)g_authFailures, (unsigned long)g_authMs);
+  printLatency("⏱️ Độ trễ loop", latency::RANGE, latency::LOGIN);
+  printLatency("⏱️ Độ trễ mạng", latency::LOGIN, latency::STAGE_COUNT);
+  lastSummaryAt = hal::millis();
+  summaryShown = true;
+}
+
+// full: cả bảng + tổng hợp (lần đầu luôn full). Trả true nếu đã in dòng tổng hợp
+bool printStatus(bool full) {
+  if (!summaryShown) full = true;   // lần đầu sau khởi động
+  int changed = 0;
   for (int i = 0; i < NUM_SLOTS; i++) {
-    String status = slots[i].occupied ? "🚗 Có xe " : "🟢 Trống  ";
-    String plate = "-", userId = "-", inAt = "-", outAt = "-";
-    int idx = findParkedIndexBySlot(i + 1);
-    if (idx >= 0) {
-      auto &pc = parkedCars[idx];
-      plate  = pc.plate; userId = pc.userId;
-
-      if (pc.checkInAt.length() > 18)  inAt  = pc.checkInAt.substring(0, 19);
-      else if (pc.checkInAt.length() > 0) inAt = pc.checkInAt;
-
-      if (pc.checkOutAt.length() > 18) outAt = pc.checkOutAt.substring(0, 19);
-      else if (pc.checkOutAt.length() > 0) outAt = pc.checkOutAt;
+    if (!full && !rowChanged(i)) continue;
+    if (!changed++) {
+      if (full) Serial.println("\n📋 ====== TRẠNG THÁI HIỆN TẠI ======");
+      else Serial.println("\n📋 ====== SLOT THAY ĐỔI ======");
+      Serial.println(TABLE_RULE);
+      Serial.println(TABLE_HEADER);
+      Serial.println(TABLE_RULE);
     }
-    char line[360];
-    snprintf(line, sizeof(line), "|  %-2d |   %6.1f cm | %-9s| %-11s| %-36s| %-19s | %-19s |",
-             i + 1, slots[i].distance, status.c_str(), plate.c_str(), userId.c_str(),
-             inAt.c_str(), outAt.c_str());
-    Serial.println(line);
-  }
-  Serial.println("+-----+-------------+-----------+-------------+--------------------------------------+---------------------+---------------------+");
-  Serial.printf("🅿️ Xe đang đậu: %d/%d | FreeHeap=%uB\n", parkedCount, NUM_SLOTS, ESP.getFreeHeap());
+    printRow(i);
+  }
+  if (changed) Serial.println(TABLE_RULE);
+  bool summary = full || changed || !summaryShown || hal::millis() - lastSummaryAt >= STATUS_SUMMARY_INTERVAL_MS;
+  if (!summary) return false;
+  printSummary();
   Serial.println("===========================================================================================================================\n");
+  return true;
+}
+
+// Lệnh qua Serial: 's' → in cả bảng + tổng hợp ngay (vd. vừa mở serial monitor, log cũ đã trôi)
+void serviceConsole() {
+  bool full = false;
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == 's' || c == 'S') full = true;
+  }
+  if (full) emitTelemetry(printStatus(true));
 }
 
 void initHardware() {
   Serial.println("🔧 Khởi tạo hardware...");
   for (int i = 0; i < NUM_SLOTS; i++) {
-    pinMode(slots[i].trig, OUTPUT);
-    pinMode(slots[i].echo, INPUT);
-    pinMode(slots[i].ledGreen, OUTPUT);
-    pinMode(slots[i].ledRed, OUTPUT);
-    slots[i].servo.attach(slots[i].servoPin);
-    slots[i].servo.write(0);
+    const SlotPins& pins = slotPins(i);
+    hal::ultrasonicBegin(i, pins.trig, pins.echo);
+    hal::pinOutput(pins.ledGreen);
+    hal::pinOutput(pins.ledRed);
+    hal::servoBegin(i, pins.servo);
+    hal::servoWrite(i, 0);
     slots[i].distance = 400;
-    slots[i].occupied = false;
+    slots[i].fresh = false;
     slots[i].state = SLOT_IDLE;
     slots[i].stateStartTime = 0;
-    digitalWrite(slots[i].ledGreen, HIGH);
-    digitalWrite(slots[i].ledRed, LOW);
+    hal::writePin(pins.ledGreen, true);
+    hal::writePin(pins.ledRed, false);
   }
-  Serial.println("✅ Hardware sẵn sàng!");
+  slotFilter.reset(SLOT_FILTER);
+  serialPrintf("✅ Hardware sẵn sàng! (%d slot)\n", NUM_SLOTS);
 }
 
-String generatePlate() {
+void generatePlate(PlateStr& out) {
   if (random(0, 100) < 70 && DATABASE_COUNT > 0) {
     int idx = random(0, DATABASE_COUNT);
-    Serial.println("📋 Lấy biển số từ DB: " + DATABASE[idx].plate);
-    return DATABASE[idx].plate;
+    serialPrintf("📋 Lấy biển số từ DB: %s\n", DATABASE[idx].plate);
+    copyField(out, DATABASE[idx].plate);
+    return;
   }
   int prefix = random(11, 100); char letter = 'A' + random(0, 26); int suffix = random(1, 100000);
-  char p[12]; sprintf(p, "%02d%c-%05d", prefix, letter, suffix);
-  Serial.println("🎲 Sinh biển số ngẫu nhiên: " + String(p));
-  return String(p);
+  snprintf(out, sizeof(out), "%02d%c-%05d", prefix, letter, suffix);
+  serialPrintf("🎲 Sinh biển số ngẫu nhiên: %s\n", out);
 }
 
 // ================== SERVO STATE ==================
+latency::Mark gateFrom[NUM_SLOTS];   // lúc phát hiện xe vào → span GATE khi servo mở
+
 void updateServoStateMachine(int slotIdx) {
   Slot &s = slots[slotIdx];
-  unsigned long now = millis();
+  uint32_t now = hal::millis();
   switch(s.state) {
     case SLOT_IDLE: break;
     case SLOT_OPENING:
-      s.servo.write(90);
+      hal::servoWrite(slotIdx, 90);
+      latency::recordSince(latency::GATE, gateFrom[slotIdx]);
       s.state = SLOT_WAIT_CLOSE;
       s.stateStartTime = now;
-      Serial.printf("🚪 Slot %d: Servo MỞ (90°)\n", slotIdx + 1);
+      serialPrintf("🚪 Slot %d: Servo MỞ (90°)\n", slotIdx + 1);
       break;
     case SLOT_WAIT_CLOSE:
       if (now - s.stateStartTime >= SERVO_OPEN_DURATION_MS) {
-        s.servo.write(0);
+        hal::servoWrite(slotIdx, 0);
         s.state = SLOT_IDLE;
-        Serial.printf("🚪 Slot %d: Servo ĐÓNG (0°)\n", slotIdx + 1);
+        serialPrintf("🚪 Slot %d: Servo ĐÓNG (0°)\n", slotIdx + 1);
       }
       break;
   }
 }
 
-// ================== LUỒNG CHÍNH ==================
-void updateSlotStatus() {
-  for (int i = 0; i < NUM_SLOTS; i++) {
-    updateServoStateMachine(i);
+// ================== NETWORK TASK ==================
+// Mọi API call chạy trên task riêng; loop() chỉ đẩy job vào hàng đợi và nhận kết quả
+// → cảm biến, LED, servo không bao giờ chờ HTTP (cold start Render, timeout 20s, retry)
+enum NetJobType : uint8_t { NET_CHECKIN, NET_CHECKOUT };
+
+// POD: hàng đợi copy theo byte; cũng là payload bản ghi journal
+struct NetJob {
+  NetJobType type;
+  uint8_t slotIdx;
+  uint32_t eventMs;     // millis() lúc phát hiện xe vào/ra (slot event gửi kèm tuổi sự kiện)
+  PlateStr plate;
+  HistoryIdStr historyId;   // check-out; rỗng nếu check-in chưa lên server → network task tự điền
+};
+static_assert(sizeof(NetJob) <= JOURNAL_PAYLOAD_SIZE, "NetJob phải vừa payload journal");
+
+struct NetResult {
+  NetJobType type;
+  uint8_t slotIdx;
+  bool ok;
+  PlateStr plate;
+  UserIdStr userId;
+  HistoryIdStr historyId;
+  TimeStr at;           // check-in hoặc check-out time
+  int16_t eventCode;    // mã HTTP của chính request sự kiện (slot event / check-in / check-out), 0 = chưa gửi
+  bool rejected;        // server từ chối hẳn (rejectedByServer) → gửi lại vô ích, bỏ khỏi journal
+};
 
-    float dist = readDistanceCM(slots[i].trig, slots[i].echo);
-    slots[i].distance = dist;
+// 4xx của chính request sự kiện = server từ chối hẳn (dữ liệu sai, phiên không tồn tại).
+// 401 (login lại vẫn lỗi), 408, 429 là lỗi tạm; mọi lỗi khác (mất mạng, 5xx, 2xx parse lỗi, login
+// 200 không có token, hết scratch) cũng là tạm → sự kiện nằm lại journal, không mất
+bool rejectedByServer(int code) { return code >= 400 && code < 500 && code != 401 && code != 408 && code != 429; }
+
+hal::Queue netJobs = nullptr;
+hal::Queue netResults = nullptr;
+
+// Journal: chỉ network task ghi/đọc
+bool g_journalReady = false;
+uint32_t g_bootSeq = 0;                  // seq đầu tiên của lần khởi động này
+const char* g_deviceId = "";
+
+// Phiên gần nhất mỗi slot theo server (network task): xe vào lúc mất mạng thì parkedCars
+// chưa có historyId khi xe ra → check-out lấy ở đây
+HistoryIdStr slotHistoryId[NUM_SLOTS];
+TimeStr slotCheckInAt[NUM_SLOTS];
+
+// ---- Lô trạng thái slot (chỉ network task đọc/ghi) ----
+const char* pendingStatus[NUM_SLOTS] = {};   // nullptr = không có thay đổi chờ gửi
+int pendingStatusCount = 0;
+uint32_t statusFlushAtMs = 0;                 // hạn gửi lô
+bool statusRetrying = false;                  // lần gửi trước lỗi → chỉ gửi lại khi tới hạn
+bool g_bulkStatusRoute = true;                // false: server cũ → PUT từng slot
+
+void queueSlotStatus(int slotId, const char* status) {
+  if (!pendingStatus[slotId - 1] && pendingStatusCount++ == 0) statusFlushAtMs = hal::millis() + STATUS_BATCH_WINDOW_MS;
+  pendingStatus[slotId - 1] = status;
+}
 
-    bool prev = slots[i].occupied;
-    bool now  = prev ? (dist < FREE_THRESH) : (dist < OCCUPY_THRESH);
+// Thời gian chờ tới lần gửi lô kế tiếp (0 = gửi ngay), WAIT_FOREVER nếu không có gì chờ gửi
+uint32_t statusBatchWaitMs() {
+  if (pendingStatusCount == 0) return hal::WAIT_FOREVER;
+  if (pendingStatusCount >= STATUS_BATCH_MAX && !statusRetrying) return 0;
+  int32_t left = (int32_t)(statusFlushAtMs - hal::millis());
+  return left > 0 ? (uint32_t)left : 0;
+}
 
-    // XE VÀO
-    if (!prev && now && parkedCount < NUM_SLOTS) {
-      String plate = generatePlate();
-      Serial.printf("🚗 === XE VÀO SLOT %d ===\n", i + 1);
-      Serial.println("🔍 Biển số: " + plate);
+void flushSlotStatuses() {
+  bool ok = false;
+  if (g_bulkStatusRoute) {
+    int code;
+    ok = putSlotStatuses(pendingStatus, code);
+    if (!ok && code == 404) {
+      Serial.println("ℹ️ Server chưa có PUT slot status theo lô (404) → PUT từng slot");
+      g_bulkStatusRoute = false;
+    }
+    if (ok) for (int i = 0; i < NUM_SLOTS; i++) pendingStatus[i] = nullptr;
+  }
+  if (!g_bulkStatusRoute) {
+    for (int i = 0; i < NUM_SLOTS; i++) {
+      if (pendingStatus[i] && putSlotStatus(i + 1, pendingStatus[i])) pendingStatus[i] = nullptr;
+    }
+  }
 
-      String userId = fetchUserIdByPlate(plate);
-      if (userId.length() > 0 && userId != "null") {
-        Serial.println("✅ Tìm thấy userId: " + userId + " cho plate: " + plate);
-      } else {
-        Serial.println("ℹ️ Chưa có user theo plate — vẫn CHECK-IN bằng plate+slot (server sẽ ghi lịch sử, có thể trả user_id).");
-      }
+  pendingStatusCount = 0;
+  for (int i = 0; i < NUM_SLOTS; i++) if (pendingStatus[i]) pendingStatusCount++;
+  statusRetrying = pendingStatusCount > 0;
+  if (statusRetrying) {
+    serialPrintf("⚠️ PUT slot status fail → thử lại %d slot sau %lu ms\n", pendingStatusCount, (unsigned long)WIFI_RETRY_DELAY_MS);
+    statusFlushAtMs = hal::millis() + WIFI_RETRY_DELAY_MS;
+  }
+}
 
-      String historyId, checkInAt, resolvedUserFromServer = "";
-      bool okIn = apiCheckIn(userId, plate, i + 1, historyId, checkInAt, &resolvedUserFromServer);
+#if USE_SLOT_EVENT
+// Chỉ network task đọc/ghi; về false khi server trả 404 cho slot event (bản backend cũ)
+bool g_slotEventRoute = true;
+
+// Trả true nếu đã xử lý xong bằng slot event (ok ghi vào *ok); false → dùng chuỗi request cũ
+bool trySlotEvent(const NetJob& job, bool in, const char* eventId, uint32_t ageMs,
+                  HistoryIdStr& outHistoryId, TimeStr& outAt, UserIdStr* outUserId, bool* ok, int& code) {
+  if (!g_slotEventRoute) return false;
+  *ok = apiSlotEvent(in, job.slotIdx + 1, job.plate, job.historyId, eventId, ageMs,
+                     outHistoryId, outAt, outUserId, code);
+  if (*ok || code != 404) return true;
+  Serial.println("ℹ️ Server chưa có slot event (404) → dùng GET plate + CHECK-IN/OUT + PUT status");
+  g_slotEventRoute = false;
+  return false;
+}
+#endif
 
-      if (!okIn) {
-        Serial.println("❌ CHECK-IN FAIL → KHÔNG đổi trạng thái");
-      } else {
-        String localUserId = (userId.length() ? userId : String("(empty)"));
-        String serverUserId = (resolvedUserFromServer.length() > 0 && resolvedUserFromServer != "null") 
-                              ? resolvedUserFromServer : String("(empty)");
-        
-        Serial.println("🔎 userId(local before resolve)=" + localUserId);
-        Serial.println("🔎 userId(server history)=" + serverUserId);
-        
-        // So sánh và hiển thị kết quả
-        if (localUserId == serverUserId) {
-          Serial.println("✅ KHỚP: userId local và server giống nhau!");
-        } else if (localUserId == "(empty)" && serverUserId != "(empty)") {
-          Serial.println("ℹ️ SYNC: Local empty → sử dụng server userId");
-          userId = resolvedUserFromServer; // đồng bộ theo server/history
-        } else if (localUserId != "(empty)" && serverUserId == "(empty)") {
-          Serial.println("⚠️ WARNING: Local có userId nhưng server trả empty");
-        } else {
-          Serial.println("❌ KHÔNG KHỚP: Local=" + localUserId + " ≠ Server=" + serverUserId);
-          userId = resolvedUserFromServer; // ưu tiên server/history
-        }
-
-        Serial.println("✅ CHECK-IN OK | historyId=" + historyId + " | at=" + checkInAt);
-
-        if (!putSlotStatus(i + 1, "occupied")) Serial.println("⚠️ PUT occupied fail");
-
-        parkedCars[parkedCount++] = {plate, i + 1, userId, historyId, checkInAt, ""};
-        slots[i].occupied = true;
-
-        digitalWrite(slots[i].ledGreen, LOW);
-        digitalWrite(slots[i].ledRed, HIGH);
-
-        slots[i].state = SLOT_OPENING;
-      }
+bool netCheckIn(const NetJob& job, const char* eventId, uint32_t ageMs, NetResult& res) {
+  const char* plate = job.plate;
+  int slotId = job.slotIdx + 1;
+
+#if USE_SLOT_EVENT
+  bool eventOk;
+  int code;
+  if (trySlotEvent(job, true, eventId, ageMs, res.historyId, res.at, &res.userId, &eventOk, code)) {
+    res.eventCode = code;
+    if (!eventOk) { Serial.println("❌ CHECK-IN FAIL"); return false; }
+    plateCacheCheck(plate, res.userId);
+    serialPrintf("✅ CHECK-IN OK | historyId=%s | at=%s\n", res.historyId, res.at);
+    return true;
+  }
+#endif
+
+  UserIdStr userId;
+  fetchUserIdByPlate(plate, userId);
+  if (hasValue(userId)) {
+    serialPrintf("✅ Tìm thấy userId: %s cho plate: %s\n", userId, plate);
+  } else {
+    Serial.println("ℹ️ Chưa có user theo plate — vẫn CHECK-IN bằng plate+slot (server sẽ ghi lịch sử, có thể trả user_id).");
+  }
+
+  UserIdStr resolvedUserFromServer = "";
+  int checkInCode;
+  bool checkedIn = apiCheckIn(userId, plate, slotId, res.historyId, res.at, &resolvedUserFromServer, checkInCode);
+  res.eventCode = checkInCode;
+  if (!checkedIn) {
+    Serial.println("❌ CHECK-IN FAIL");
+    return false;
+  }
+
+  const char* localUserId = userId[0] ? userId : "(empty)";
+  const char* serverUserId = hasValue(resolvedUserFromServer) ? resolvedUserFromServer : "(empty)";
+  bool localEmpty = !userId[0], serverEmpty = !hasValue(resolvedUserFromServer);
+  plateCacheCheck(plate, resolvedUserFromServer);
+
+  serialPrintf("🔎 userId(local before resolve)=%s\n", localUserId);
+  serialPrintf("🔎 userId(server history)=%s\n", serverUserId);
+
+  // So sánh và hiển thị kết quả
+  if (!strcmp(localUserId, serverUserId)) {
+    Serial.println("✅ KHỚP: userId local và server giống nhau!");
+  } else if (localEmpty && !serverEmpty) {
+    Serial.println("ℹ️ SYNC: Local empty → sử dụng server userId");
+    copyField(userId, resolvedUserFromServer); // đồng bộ theo server/history
+  } else if (!localEmpty && serverEmpty) {
+    Serial.println("⚠️ WARNING: Local có userId nhưng server trả empty");
+  } else {
+    serialPrintf("❌ KHÔNG KHỚP: Local=%s ≠ Server=%s\n", localUserId, serverUserId);
+    copyField(userId, resolvedUserFromServer); // ưu tiên server/history
+  }
+
+  serialPrintf("✅ CHECK-IN OK | historyId=%s | at=%s\n", res.historyId, res.at);
+
+  queueSlotStatus(slotId, "occupied");
+
+  copyField(res.userId, userId);
+  return true;
+}
+
+bool netCheckOut(const NetJob& job, const char* eventId, uint32_t ageMs, NetResult& res) {
+  const char* historyId = job.historyId;
+  const char* checkInAt = !strcmp(historyId, slotHistoryId[job.slotIdx]) ? slotCheckInAt[job.slotIdx] : "";
+  int slotId = job.slotIdx + 1;
+
+  bool okOut = false;
+#if USE_SLOT_EVENT
+  HistoryIdStr closedHistoryId = "";
+  int code = 0;
+  bool viaEvent = trySlotEvent(job, false, eventId, ageMs, closedHistoryId, res.at, nullptr, &okOut, code);
+  if (viaEvent) res.eventCode = code;
+#else
+  bool viaEvent = false;
+#endif
+  if (!viaEvent) {
+    int code;
+    if (hasValue(historyId)) { okOut = apiCheckOut(historyId, res.at, code); res.eventCode = code; }
+    else {
+      // Route cũ cần historyId; không có thì không bao giờ gửi được → bỏ, không chặn journal mãi
+      serialPrintf("⚠️ Không thể check-out: historyId không hợp lệ (%s)\n", historyId);
+      res.rejected = true;
     }
+  }
 
-    // XE RA
-    if (prev && !now) {
-      int idx = findParkedIndexBySlot(i + 1);
-      Serial.printf("🚙 === XE RA KHỎI SLOT %d ===\n", i + 1);
+  if (okOut) serialPrintf("✅ CHECK-OUT OK | at=%s\n", res.at);
+  else       Serial.println("⚠️ CHECK-OUT FAIL");
+
+  if (!viaEvent) queueSlotStatus(slotId, "available");
+
+  serialPrintf("⏱  Thời gian: in=%s | out=%s\n", checkInAt[0] ? checkInAt : "(unknown)", res.at[0] ? res.at : "(unknown)");
+
+  copyField(res.historyId, historyId);
+  return okOut;
+}
+
+// Gửi 1 sự kiện. eventId rỗng = không có idempotency key (không có flash journal)
+bool runJob(NetJob& job, const char* eventId, uint32_t ageMs, NetResult& res) {
+  if (job.type == NET_CHECKOUT && !job.historyId[0]) copyField(job.historyId, slotHistoryId[job.slotIdx]);
+  res = {};
+  res.type = job.type;
+  res.slotIdx = job.slotIdx;
+  memcpy(res.plate, job.plate, sizeof(res.plate));
+
+  hal::HttpStats before = hal::httpStats();
+  uint32_t startMs = hal::millis();
+  res.ok = (job.type == NET_CHECKIN) ? netCheckIn(job, eventId, ageMs, res) : netCheckOut(job, eventId, ageMs, res);
+  if (!res.ok && rejectedByServer(res.eventCode)) res.rejected = true;
+  hal::HttpStats after = hal::httpStats();
+  serialPrintf("🔐 %s slot %d: %u request, %u handshake (%u ms) / tổng %u ms\n",
+               job.type == NET_CHECKIN ? "CHECK-IN" : "CHECK-OUT", job.slotIdx + 1,
+               after.requests - before.requests, after.handshakes - before.handshakes,
+               after.handshakeMs - before.handshakeMs, hal::millis() - startMs);
+
+  // Chỉ giữ phiên vừa check-in thành công. Check-in lỗi (có thể server vẫn ghi, vd. 201 nhưng parse
+  // lỗi) hoặc đã thử check-out → xoá: historyId cũ của xe trước làm slot event "out" không khớp phiên
+  // nào (400), còn rỗng thì server đóng phiên đang mở của slot
+  if (res.ok && job.type == NET_CHECKIN) {
+    copyField(slotHistoryId[job.slotIdx], res.historyId);
+    copyField(slotCheckInAt[job.slotIdx], res.at);
+  } else {
+    slotHistoryId[job.slotIdx][0] = 0;
+    slotCheckInAt[job.slotIdx][0] = 0;
+  }
+  return res.ok;
+}
+
+// Span ARRIVAL (xe vào → server nhận check-in) theo millis(): eventMs được ghi trên core kia.
+// Chỉ gọi cho sự kiện của lần khởi động này (millis() cùng gốc)
+void noteArrival(const NetJob& job, bool ok) {
+  if (ok && job.type == NET_CHECKIN) latency::recordMs(latency::ARRIVAL, hal::millis() - job.eventMs);
+}
+
+// ---- Gửi bù journal (chỉ network task) ----
+uint32_t replayTat = 0;          // GCRA: thời điểm lý thuyết của lần gửi kế tiếp
+uint32_t replayNotBefore = 0;    // jitter sau khi có WiFi lại, hoặc backoff sau lỗi tạm
+uint32_t replayBackoffMs = 0;
+bool replayOffline = false;
+uint32_t jitterState = 1;        // xorshift riêng: random() của Arduino dùng chung với loop()
+
+uint32_t jitterMs(uint32_t maxMs) {
+  jitterState ^= jitterState << 13; jitterState ^= jitterState >> 17; jitterState ^= jitterState << 5;
+  return jitterState % (maxMs + 1);
+}
+
+// Thời gian chờ tới lần gửi bù kế tiếp (0 = gửi ngay), WAIT_FOREVER nếu journal rỗng
+uint32_t replayWaitMs() {
+  if (journal::pending() == 0) return hal::WAIT_FOREVER;
+  if (!hal::wifiConnected()) { replayOffline = true; return WIFI_POLL_MS; }
+  uint32_t now = hal::millis();
+  if (replayOffline) {
+    replayOffline = false;
+    replayNotBefore = now + jitterMs(REPLAY_JITTER_MS);
+    serialPrintf("📶 WiFi OK → gửi bù %lu sự kiện sau %lu ms\n",
+                 (unsigned long)journal::pending(), (unsigned long)(replayNotBefore - now));
+  }
+  int32_t waitBurst = (int32_t)(replayTat - (REPLAY_BURST - 1) * REPLAY_INTERVAL_MS - now);
+  int32_t waitGate  = (int32_t)(replayNotBefore - now);
+  int32_t wait = waitBurst > waitGate ? waitBurst : waitGate;
+  return wait > 0 ? (uint32_t)wait : 0;
+}
+
+// Gửi bản ghi cũ nhất; chỉ bỏ khỏi journal khi server đã nhận hoặc từ chối hẳn (res.rejected)
+void replayNext() {
+  NetJob job;
+  uint8_t len;
+  uint32_t seq;
+  if (!journal::peek(&job, len, seq)) return;
+  if (len != sizeof(job)) { journal::pop(); g_journalPending = journal::pending(); return; }
+
+  char eventId[32];
+  snprintf(eventId, sizeof(eventId), "%s-%lu", g_deviceId, (unsigned long)seq);
+  uint32_t ageMs = seq >= g_bootSeq ? hal::millis() - job.eventMs : NO_EVENT_AGE;
+
+  NetResult res;
+  bool ok = runJob(job, eventId, ageMs, res);
+  if (seq >= g_bootSeq) noteArrival(job, ok);
+
+  uint32_t now = hal::millis();
+  if ((int32_t)(now - replayTat) > 0) replayTat = now;
+  replayTat += REPLAY_INTERVAL_MS;
+
+  if (!ok && !res.rejected) {
+    replayBackoffMs = replayBackoffMs ? replayBackoffMs * 2 : REPLAY_BACKOFF_MIN_MS;
+    if (replayBackoffMs > REPLAY_BACKOFF_MAX_MS) replayBackoffMs = REPLAY_BACKOFF_MAX_MS;
+    replayNotBefore = now + replayBackoffMs + jitterMs(replayBackoffMs / 2);
+    serialPrintf("⏳ Sự kiện %s lỗi tạm (%d) → thử lại sau %lu ms\n", eventId, res.eventCode,
+                 (unsigned long)(replayNotBefore - now));
+    return;
+  }
+  replayBackoffMs = 0;
+  if (!ok) serialPrintf("⚠️ Sự kiện %s bị server từ chối (%d) → bỏ khỏi journal\n", eventId, res.eventCode);
+  journal::pop();
+  g_journalPending = journal::pending();
+  hal::queueSend(netResults, &res, hal::WAIT_FOREVER);
+}
+
+// Job mới từ loop(): ghi journal trước, replayNext() gửi theo thứ tự
+void acceptJob(NetJob& job) {
+  uint32_t seq;
+  if (g_journalReady) {
+    if (journal::append(&job, sizeof(job), seq)) { g_journalPending = journal::pending(); return; }
+    g_journalDropped++;
+    serialPrintf("❌ Journal đầy (%lu sự kiện) → bỏ %s slot %d\n", (unsigned long)journal::pending(),
+                 job.type == NET_CHECKIN ? "CHECK-IN" : "CHECK-OUT", job.slotIdx + 1);
+    return;
+  }
+  // Không có flash: gửi ngay như trước, mất mạng thì mất sự kiện
+  NetResult res;
+  noteArrival(job, runJob(job, "", hal::millis() - job.eventMs, res));
+  hal::queueSend(netResults, &res, hal::WAIT_FOREVER);
+}
 
-      if (idx >= 0) {
-        auto &pc = parkedCars[idx];
-        Serial.println("📋 Biển số: " + pc.plate);
-        Serial.println("👤 UserID: " + pc.userId);
+void netTask(void*) {
+  g_journalReady = journal::begin();
+  g_bootSeq = journal::nextSeq();
+  g_journalPending = journal::pending();
+  g_deviceId = hal::deviceId();
+  jitterState = hal::randomSeedValue() | 1;
+  if (g_journalReady) {
+    serialPrintf("📒 Journal: %lu sự kiện chờ gửi / %lu ô (node %s)\n", (unsigned long)journal::pending(),
+                 (unsigned long)journal::capacity(), g_deviceId);
+  } else {
+    Serial.println("⚠️ Không có flash cho journal → gửi trực tiếp, mất mạng sẽ mất sự kiện");
+  }
 
-        String outAt;
-        bool okOut = false;
-        if (pc.historyId.length() > 0 && pc.historyId != "null") okOut = apiCheckOut(pc.historyId, outAt);
-        else Serial.println("⚠️ Không thể check-out: historyId không hợp lệ (" + pc.historyId + ")");
+  NetJob job;
+  while (true) {
+    // Chờ job, nhưng không quá hạn gửi lô trạng thái / lượt gửi bù kế tiếp
+    uint32_t wait = statusBatchWaitMs();
+    uint32_t replayWait = replayWaitMs();
+    if (replayWait < wait) wait = replayWait;
+    uint32_t authWait = authWaitMs();
+    if (authWait < wait) wait = authWait;
+    while (hal::queueReceive(netJobs, &job, wait)) { acceptJob(job); wait = 0; }
+
+    if (authWaitMs() == 0) refreshToken();   // trước các request → không request nào dùng token sắp hết hạn
+    if (statusBatchWaitMs() == 0) flushSlotStatuses();
+    if (replayWaitMs() == 0) replayNext();
+  }
+}
 
-        if (okOut) {
-          pc.checkOutAt = outAt;
-          Serial.println("✅ CHECK-OUT OK | at=" + outAt);
-        } else {
-          Serial.println("⚠️ CHECK-OUT FAIL");
-        }
+void startNetworkTask() {
+  netJobs = hal::queueCreate(NET_QUEUE_LENGTH, sizeof(NetJob));
+  netResults = hal::queueCreate(NET_QUEUE_LENGTH, sizeof(NetResult));
+  if (!hal::taskStart("net", netTask, nullptr, NET_TASK_STACK, NET_TASK_PRIORITY, NET_TASK_CORE)) {
+    Serial.println("❌ Không tạo được network task");
+  }
+}
 
-        if (!putSlotStatus(i + 1, "available")) Serial.println("⚠️ PUT available fail");
+// Kết quả từ network task → state machine của slot (chạy trong loop())
+void handleNetResults() {
+  NetResult res;
+  while (hal::queueReceive(netResults, &res, 0)) {
+    int i = res.slotIdx;
+    if (res.type == NET_CHECKOUT) {
+      // Slot đã trống từ lúc xe ra; chỉ báo nếu server chưa ghi nhận
+      if (!res.ok) serialPrintf("⚠️ Slot %d: CHECK-OUT history=%s chưa ghi lên server\n", i + 1, res.historyId);
+      continue;
+    }
 
-        Serial.println("⏱  Thời gian: in=" + (pc.checkInAt.length() ? pc.checkInAt : "(unknown)") +
-                       " | out=" + (pc.checkOutAt.length() ? pc.checkOutAt : "(unknown)"));
+    // Slot đã "có xe" từ lúc phát hiện; server trả về thì điền historyId/userId
+    if (!res.ok) { serialPrintf("⚠️ Slot %d: server không nhận CHECK-IN %s → chỉ ghi nhận tại chỗ\n", i + 1, res.plate); continue; }
+    ParkedCar* pc = parkedAt(i);
+    if (!pc || strcmp(pc->plate, res.plate)) continue;   // xe đã ra trước khi check-in lên server
+    copyField(pc->userId, res.userId);
+    copyField(pc->historyId, res.historyId);
+    copyField(pc->checkInAt, res.at);
+    markRowDirty(i);
+  }
+}
 
-        removeParkedIndex(idx);
+// ================== LUỒNG CHÍNH ==================
+void updateSlotStatus() {
+  // Gom kết quả đo mới của cả bãi rồi lọc một lượt; chỉ slot có mẫu mới mới đổi trạng thái
+  static int32_t sampleMm[NUM_SLOTS], fresh[NUM_SLOTS];
+  {
+    LatencySpan span(latency::FILTER);
+    for (int i = 0; i < NUM_SLOTS; i++) {
+      sampleMm[i] = cmToMm(slots[i].distance);
+      fresh[i] = slots[i].fresh;
+      slots[i].fresh = false;
+    }
+    slotFilter.step(sampleMm, fresh, SLOT_FILTER);
+  }
+
+  for (int i = 0; i < NUM_SLOTS; i++) {
+    updateServoStateMachine(i);
+    if (!slotFilter.changed[i]) continue;
+    LatencySpan span(latency::REACT);
+    markRowDirty(i);
+    bool now  = slotFilter.occupied[i];
+    bool prev = !now;
+
+    // XE VÀO → slot "có xe" ngay, check-in vào journal rồi lên server khi có mạng
+    if (!prev && now) {
+      gateFrom[i] = latency::mark();
+      PlateStr plate;
+      generatePlate(plate);
+      serialPrintf("🚗 === XE VÀO SLOT %d ===\n", i + 1);
+      serialPrintf("🔍 Biển số: %s\n", plate);
+
+      NetJob job = {};
+      job.type = NET_CHECKIN;
+      job.slotIdx = i;
+      job.eventMs = hal::millis();
+      copyField(job.plate, plate);
+      if (!hal::queueSend(netJobs, &job, 0)) serialPrintf("⚠️ Hàng đợi mạng đầy → bỏ CHECK-IN %s\n", plate);
+
+      parkCar(i, plate);
+      hal::writePin(slotPins(i).ledGreen, false);
+      hal::writePin(slotPins(i).ledRed, true);
+      slots[i].state = SLOT_OPENING;
+    }
+
+    // XE RA → trả slot ngay, check-out chạy nền
+    if (prev && !now) {
+      serialPrintf("🚙 === XE RA KHỎI SLOT %d ===\n", i + 1);
+
+      if (const ParkedCar* pc = parkedAt(i)) {
+        serialPrintf("📋 Biển số: %s\n", pc->plate);
+        serialPrintf("👤 UserID: %s\n", pc->userId);
+
+        NetJob job = {};
+        job.type = NET_CHECKOUT;
+        job.slotIdx = i;
+        job.eventMs = hal::millis();
+        copyField(job.plate, pc->plate);
+        copyField(job.historyId, pc->historyId);
+        if (!hal::queueSend(netJobs, &job, 0)) serialPrintf("⚠️ Hàng đợi mạng đầy → bỏ CHECK-OUT history=%s\n", pc->historyId);
+
+        unparkCar(i);
       }
 
-      slots[i].occupied = false;
-      digitalWrite(slots[i].ledGreen, HIGH);
-      digitalWrite(slots[i].ledRed, LOW);
-      slots[i].servo.write(0);
+      hal::writePin(slotPins(i).ledGreen, true);
+      hal::writePin(slotPins(i).ledRed, false);
+      hal::servoWrite(i, 0);
       slots[i].state = SLOT_IDLE;
     }
   }
@@ -635,10 +1446,11 @@ void updateSlotStatus() {
 void testAPI() {
   Serial.println("\n🧪 TEST LOGIN + LICENSE PLATE");
   if (!loginAndGetToken()) { Serial.println("❌ Login thất bại"); return; }
-  String testPlate = "51D-22222";
-  String uid = fetchUserIdByPlate(testPlate);
-  if (uid.length() > 0 && uid != "null") {
-    Serial.println("✅ API OK — Tìm thấy userId: " + uid + " cho plate: " + testPlate);
+  const char* testPlate = "51D-22222";
+  UserIdStr uid;
+  fetchUserIdByPlate(testPlate, uid);
+  if (hasValue(uid)) {
+    serialPrintf("✅ API OK — Tìm thấy userId: %s cho plate: %s\n", uid, testPlate);
   } else {
     Serial.println("ℹ️ testPlate chưa có user — vẫn check-in bằng plate+slot như luồng chính.");
   }
@@ -648,41 +1460,40 @@ unsigned long nextSenseAt = 0;
 unsigned long nextPrintAt = 0;
 
 void setup() {
-  Serial.begin(115200); delay(1200);
+  Serial.begin(115200); hal::delayMs(1200);
   Serial.println("\n🚗 SMART PARKING (FINAL — USER-ID SYNC WITH SERVER)");
-  WiFi.mode(WIFI_STA); WiFi.begin(WIFI_SSID, WIFI_PASS);
   Serial.print("🌐 Kết nối WiFi");
-  int tries=0;
-  while (WiFi.status()!=WL_CONNECTED && tries<30){
-    Serial.print(".");
-    delay(500);
-    tries++;
-  }
-  Serial.println(WiFi.status()==WL_CONNECTED ? "\n✅ WiFi OK" : "\n❌ WiFi FAIL");
+  bool wifiOk = hal::wifiConnect(WIFI_SSID, WIFI_PASS, WIFI_CONNECT_TIMEOUT_MS);
+  Serial.println(wifiOk ? "\n✅ WiFi OK" : "\n❌ WiFi FAIL");
 
-  g_tlsClient.setInsecure();
-  g_tlsClient.setTimeout(HTTP_TIMEOUT_MS);
-  randomSeed(esp_random());
+  hal::httpInit(HTTP_TIMEOUT_MS);
+  randomSeed(hal::randomSeedValue());
   initHardware();
 
-  if (WiFi.status()==WL_CONNECTED) {
-    delay(500);
+  if (wifiOk) {
+    hal::delayMs(500);
     testAPI();
   }
+  startNetworkTask();
 
-  unsigned long now = millis();
+  unsigned long now = hal::millis();
   nextSenseAt = now + SENSE_INTERVAL_MS;
   nextPrintAt = now + PRINT_INTERVAL_MS;
 }
 
+unsigned long nextWifiRetryAt = 0;
+
 void loop() {
-  if (WiFi.status() != WL_CONNECTED) {
+  // Mất WiFi: chỉ gọi reconnect định kỳ; cảm biến/servo vẫn chạy, sự kiện nằm trong journal
+  if (!hal::wifiConnected() && hal::millis() >= nextWifiRetryAt) {
     Serial.println("⚠️ Mất WiFi, reconnect...");
-    WiFi.reconnect();
-    delay(WIFI_RETRY_DELAY_MS);
-    return;
+    hal::wifiReconnect();
+    nextWifiRetryAt = hal::millis() + WIFI_RETRY_DELAY_MS;
   }
-  unsigned long now = millis();
+  rangingService();
+  handleNetResults();
+  unsigned long now = hal::millis();
   if (now >= nextSenseAt) { updateSlotStatus(); nextSenseAt = now + SENSE_INTERVAL_MS; }
-  if (now >= nextPrintAt) { printStatus();      nextPrintAt = now + PRINT_INTERVAL_MS; }
+  if (now >= nextPrintAt) { emitTelemetry(printStatus(false)); nextPrintAt = now + PRINT_INTERVAL_MS; }
+  serviceConsole();
 }
@@ -0,0 +1,88 @@
+// == Scratch arena (xem include/scratch.h) ==
+#include "scratch.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Mỗi khối có header ghi kích thước → ArduinoJson reallocate/deallocate được khối trên cùng
+struct Header {
+  uint32_t size;
+  uint32_t reserved;   // giữ payload căn 8 byte
+};
+static_assert(sizeof(Header) == 8, "Header phải giữ căn 8 byte");
+
+alignas(8) static uint8_t g_buf[SCRATCH_BYTES];
+static size_t g_used = 0;
+static size_t g_peak = 0;
+static uint32_t g_failures = 0;
+
+static size_t roundUp(size_t n) { return (n + 7) & ~(size_t)7; }
+static Header* headerOf(void* p) { return (Header*)p - 1; }
+static size_t endOf(void* p) { return (uint8_t*)p - g_buf + roundUp(headerOf(p)->size); }
+
+static void setUsed(size_t used) {
+  g_used = used;
+  if (used > g_peak) g_peak = used;
+}
+
+// realloc: khối trên cùng co/giãn tại chỗ, khối khác thì copy sang khối mới (khối cũ bỏ tới khi rewind)
+static void* resize(void* p, size_t bytes) {
+  if (!p) return scratch::alloc(bytes);
+  Header* h = headerOf(p);
+  if (endOf(p) == g_used) {
+    size_t end = (uint8_t*)p - g_buf + roundUp(bytes);
+    if (end > SCRATCH_BYTES) { g_failures++; return nullptr; }
+    h->size = (uint32_t)bytes;
+    setUsed(end);
+    return p;
+  }
+  if (bytes <= h->size) return p;
+  void* q = scratch::alloc(bytes);
+  if (q) memcpy(q, p, h->size);
+  return q;
+}
+
+// Chỉ khối trên cùng trả lại được ngay; còn lại chờ ScratchScope
+static void dispose(void* p) {
+  if (p && endOf(p) == g_used) g_used = (uint8_t*)headerOf(p) - g_buf;
+}
+
+class JsonScratch : public ArduinoJson::Allocator {
+public:
+  void* allocate(size_t size) override { return scratch::alloc(size); }
+  void deallocate(void* ptr) override { dispose(ptr); }
+  void* reallocate(void* ptr, size_t size) override { return resize(ptr, size); }
+};
+static JsonScratch g_json;
+
+namespace scratch {
+
+void* alloc(size_t bytes) {
+  size_t need = sizeof(Header) + roundUp(bytes);
+  if (need > SCRATCH_BYTES - g_used) { g_failures++; return nullptr; }
+  Header* h = (Header*)(g_buf + g_used);
+  h->size = (uint32_t)bytes;
+  setUsed(g_used + need);
+  return h + 1;
+}
+
+const char* format(const char* fmt, ...) {
+  va_list args, measure;
+  va_start(args, fmt);
+  va_copy(measure, args);
+  int len = vsnprintf(nullptr, 0, fmt, measure);
+  va_end(measure);
+  char* out = len >= 0 ? (char*)alloc((size_t)len + 1) : nullptr;
+  if (out) vsnprintf(out, (size_t)len + 1, fmt, args);
+  va_end(args);
+  return out ? out : "";
+}
+
+size_t mark() { return g_used; }
+void rewind(size_t mark) { if (mark <= g_used) g_used = mark; }
+size_t peak() { return g_peak; }
+uint32_t failures() { return g_failures; }
+ArduinoJson::Allocator* json() { return &g_json; }
+
+}  // namespace scratch
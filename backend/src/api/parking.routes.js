@@ -95,6 +95,56 @@ router.get('/current', parkingController.getCurrentSession);
 router.post('/admin/checkin', authMiddleware.requireAdmin, parkingController.checkInForUser);
 router.post('/admin/checkout', authMiddleware.requireAdmin, parkingController.checkOutForUser);
 
+/**
+ * @swagger
+ * /api/parking/slot-event:
+ *   post:
+ *     summary: Thiết bị - Xe vào/ra slot trong một request (tra biển số + lịch sử + trạng thái slot)
+ *     tags: [Parking History]
+ *     security:
+ *       - bearerAuth: []
+ *     requestBody:
+ *       required: true
+ *       content:
+ *         application/json:
+ *           schema:
+ *             type: object
+ *             required: [slot_id, direction]
+ *             properties:
+ *               slot_id:
+ *                 type: integer
+ *               direction:
+ *                 type: string
+ *                 enum: [in, out]
+ *               license_plate:
+ *                 type: string
+ *               history_id:
+ *                 type: integer
+ *                 description: Phiên cần đóng khi direction=out (không có thì đóng phiên đang mở của slot)
+ *               age_ms:
+ *                 type: integer
+ *                 description: Sự kiện xảy ra cách đây bao nhiêu ms
+ *               event_id:
+ *                 type: string
+ *                 description: Idempotency key của thiết bị (deviceId-seq); gửi lại cùng event_id không ghi trùng
+ *           example:
+ *             slot_id: 1
+ *             direction: "in"
+ *             license_plate: "51D-22222"
+ *             age_ms: 850
+ *             event_id: "A1B2C3D4E5F6-42"
+ *     responses:
+ *       201:
+ *         description: Check-in thành công (data.history, data.slot, data.user)
+ *       200:
+ *         description: Check-out thành công (data.history, data.slot_id, data.duration_minutes), hoặc event_id đã xử lý (data.duplicate = true)
+ *       400:
+ *         description: Slot không khả dụng hoặc không có phiên đang mở
+ *       403:
+ *         description: Không có quyền
+ */
+router.post('/slot-event', authMiddleware.requireAdmin, parkingController.slotEvent);
+
 // Admin history
 router.get('/admin/all', authMiddleware.requireAdmin, parkingController.adminListHistory);
 
@@ -24,6 +24,7 @@ router.get('/', slotsController.getAllSlots);
 router.get('/:id', slotsController.getSlotById);
 
 // Routes cần quyền driver trở lên (driver có thể cập nhật trạng thái khi checkin/checkout)
+router.put('/status', authMiddleware.requireDriver, slotsController.updateSlotStatuses);
 router.put('/:id/status', authMiddleware.requireDriver, slotsController.updateSlotStatus);
 
 // Routes chỉ dành cho admin
@@ -79,6 +79,123 @@ class ParkingHistoryController {
                 responseHandler.error(res, 'Lỗi server nội bộ', 500);
             }
         }
+
+        // Thiết bị (ESP32) báo xe vào/ra một slot bằng một request duy nhất
+        // - in : tra user theo biển số → ghi lịch sử → slot occupied
+        // - out: đóng phiên (history_id, hoặc phiên đang mở của slot) → slot available
+        // age_ms: sự kiện xảy ra cách đây bao lâu (thiết bị không có đồng hồ thật, job có thể phải chờ)
+        // event_id: idempotency key (thiết bị gửi lại từ journal sau timeout/mất điện) → đã xử lý thì
+        // trả lại kết quả cũ với 200, không ghi trùng
+        async slotEvent(req, res) {
+            try {
+                if (req.user.role !== 'ADMIN') return responseHandler.error(res, 'Không có quyền', 403);
+                const { slot_id, license_plate, direction, history_id, event_id } = req.body;
+                if (!slot_id || (direction !== 'in' && direction !== 'out')) {
+                    return responseHandler.error(res, 'slot_id và direction (in|out) là bắt buộc', 400);
+                }
+                const ageMs = Math.min(Math.max(parseInt(req.body.age_ms) || 0, 0), 24 * 60 * 60 * 1000);
+                const at = new Date(Date.now() - ageMs).toISOString();
+
+                const eventColumn = direction === 'in' ? 'check_in_event_id' : 'check_out_event_id';
+                const replyDuplicate = async () => {
+                    if (!event_id) return false;
+                    const { data: history } = await supabase
+                        .from('parking_history')
+                        .select('*')
+                        .eq(eventColumn, event_id)
+                        .maybeSingle();
+                    if (!history) return false;
+                    const data = direction === 'in'
+                        ? { history, slot: null, user: null }
+                        : { history, slot_id: history.slot_id,
+                            duration_minutes: Math.floor((new Date(history.check_out_time) - new Date(history.check_in_time)) / (1000 * 60)) };
+                    responseHandler.success(res, { ...data, duplicate: true }, 'Sự kiện đã được xử lý trước đó');
+                    return true;
+                };
+                if (await replyDuplicate()) return;
+
+                if (direction === 'in') {
+                    const { data: slot, error: slotError } = await supabase
+                        .from('parking_slots')
+                        .select('*')
+                        .eq('id', slot_id)
+                        .single();
+                    if (slotError || !slot) {
+                        return responseHandler.error(res, 'Không tìm thấy chỗ đỗ', 404);
+                    }
+                    if (slot.status !== 'available') {
+                        return responseHandler.error(res, 'Chỗ đỗ không khả dụng', 400);
+                    }
+
+                    // Biển số chưa đăng ký → ghi lịch sử cho user của JWT (như /checkin không có user_id)
+                    let user = null;
+                    if (license_plate) {
+                        const { data } = await supabase
+                            .from('users')
+                            .select('id, full_name, license_plate')
+                            .eq('license_plate', license_plate)
+                            .maybeSingle();
+                        user = data || null;
+                    }
+                    if (user) {
+                        const active = await require('../models/parkingHistory.model').activeForUser(user.id);
+                        if (active) {
+                            return responseHandler.error(res, `User này đang đỗ xe tại ${active.parking_slots.slot_name}. Vui lòng check-out trước khi check-in chỗ mới`, 400);
+                        }
+                    }
+
+                    const { data: history, error: historyError } = await supabase
+                        .from('parking_history')
+                        .insert([{ slot_id, user_id: user ? user.id : req.user.userId, check_in_time: at,
+                                   check_in_event_id: event_id || null }])
+                        .select()
+                        .single();
+                    // 23505: request gửi lại chạy song song đã ghi trước (UNIQUE event id)
+                    if (historyError && historyError.code === '23505' && await replyDuplicate()) return;
+                    if (historyError) {
+                        console.error('Slot event check-in error:', historyError);
+                        return responseHandler.error(res, 'Không thể thực hiện check-in', 500);
+                    }
+                    await supabase
+                        .from('parking_slots')
+                        .update({ status: 'occupied' })
+                        .eq('id', slot_id);
+                    return responseHandler.success(res, {
+                        history,
+                        slot: { ...slot, status: 'occupied' },
+                        user
+                    }, 'Check-in thành công', 201);
+                }
+
+                let query = supabase
+                    .from('parking_history')
+                    .update({ check_out_time: at, check_out_event_id: event_id || null })
+                    .is('check_out_time', null);
+                query = history_id ? query.eq('id', history_id) : query.eq('slot_id', slot_id);
+                const { data: closed, error: updateError } = await query.select();
+                if (updateError) {
+                    console.error('Slot event check-out error:', updateError);
+                    return responseHandler.error(res, 'Không thể thực hiện check-out', 500);
+                }
+                if (!closed || !closed.length) {
+                    return responseHandler.error(res, 'Không có phiên đỗ xe nào đang hoạt động', 400);
+                }
+                const history = closed[0];
+                await supabase
+                    .from('parking_slots')
+                    .update({ status: 'available' })
+                    .eq('id', history.slot_id);
+                const duration = Math.floor((new Date(history.check_out_time) - new Date(history.check_in_time)) / (1000 * 60));
+                responseHandler.success(res, {
+                    history,
+                    slot_id: history.slot_id,
+                    duration_minutes: duration
+                }, 'Check-out thành công');
+            } catch (error) {
+                console.error('Slot event error:', error);
+                responseHandler.error(res, 'Lỗi server nội bộ', 500);
+            }
+        }
     /**
      * @swagger
      * /api/parking/checkin:
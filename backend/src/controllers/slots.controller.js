@@ -320,6 +320,72 @@ class SlotsController {
         }
     }
 
+    /**
+     * @swagger
+     * /api/slots/status:
+     *   put:
+     *     summary: Cập nhật trạng thái nhiều chỗ đỗ xe trong một request (thiết bị gửi theo lô)
+     *     tags: [Parking Slots]
+     *     security:
+     *       - bearerAuth: []
+     *     requestBody:
+     *       required: true
+     *       content:
+     *         application/json:
+     *           schema:
+     *             type: object
+     *             required:
+     *               - slots
+     *             properties:
+     *               slots:
+     *                 type: array
+     *                 items:
+     *                   type: object
+     *                   properties:
+     *                     id:
+     *                       type: integer
+     *                     status:
+     *                       type: string
+     *                       enum: [available, occupied, reserved]
+     *           example:
+     *             slots: [{ id: 1, status: "occupied" }, { id: 3, status: "available" }]
+     *     responses:
+     *       200:
+     *         description: Cập nhật trạng thái thành công
+     *         content:
+     *           application/json:
+     *             schema:
+     *               $ref: '#/components/schemas/ApiResponse'
+     *       400:
+     *         description: Dữ liệu đầu vào không hợp lệ
+     *         content:
+     *           application/json:
+     *             schema:
+     *               $ref: '#/components/schemas/ErrorResponse'
+     *       401:
+     *         description: Chưa được xác thực
+     *         content:
+     *           application/json:
+     *             schema:
+     *               $ref: '#/components/schemas/ErrorResponse'
+     */
+    async updateSlotStatuses(req, res) {
+        try {
+            const { slots } = req.body;
+
+            if (!Array.isArray(slots) || slots.length === 0) {
+                return responseHandler.error(res, 'Danh sách slots là bắt buộc', 400);
+            }
+
+            const updatedSlots = await slotsService.updateSlotStatuses(slots);
+
+            responseHandler.success(res, updatedSlots, 'Cập nhật trạng thái thành công');
+        } catch (error) {
+            console.error('Update slot statuses error:', error);
+            responseHandler.error(res, error.message, 500);
+        }
+    }
+
     /**
      * @swagger
      * /api/slots/{id}:
@@ -140,6 +140,38 @@ class SlotsService {
         }
     }
 
+    // Cập nhật trạng thái nhiều chỗ đỗ một lần: gom theo trạng thái → mỗi trạng thái một query
+    async updateSlotStatuses(updates) {
+        try {
+            const allowed = ['available', 'occupied', 'reserved'];
+            const idsByStatus = {};
+            for (const { id, status } of updates) {
+                const norm = String(status).toLowerCase();
+                if (!id || !allowed.includes(norm)) {
+                    throw new Error('Trạng thái không hợp lệ. Chỉ chấp nhận: available, occupied, reserved');
+                }
+                (idsByStatus[norm] = idsByStatus[norm] || []).push(id);
+            }
+
+            const updated = [];
+            for (const [status, ids] of Object.entries(idsByStatus)) {
+                const { data, error } = await supabase
+                    .from('parking_slots')
+                    .update({ status })
+                    .in('id', ids)
+                    .select();
+                if (error) {
+                    throw new Error(error.message);
+                }
+                updated.push(...data);
+            }
+
+            return updated;
+        } catch (error) {
+            throw new Error(`Lỗi khi cập nhật chỗ đỗ: ${error.message}`);
+        }
+    }
+
     // Xóa chỗ đỗ
     async deleteSlot(id) {
         try {
@@ -0,0 +1,11 @@
+-- Thêm idempotency key cho sự kiện slot từ thiết bị (POST /api/parking/slot-event)
+-- Thiết bị gửi lại sự kiện từ journal flash khi mất mạng/timeout → cùng event_id không ghi trùng
+ALTER TABLE public.parking_history
+ADD COLUMN check_in_event_id TEXT UNIQUE,
+ADD COLUMN check_out_event_id TEXT UNIQUE;
+
+-- Thêm comment cho cột mới
+COMMENT ON COLUMN public.parking_history.check_in_event_id IS 'event_id (deviceId-seq) của sự kiện xe vào đã tạo bản ghi này';
+COMMENT ON COLUMN public.parking_history.check_out_event_id IS 'event_id (deviceId-seq) của sự kiện xe ra đã đóng bản ghi này';
+
+SELECT 'Added check_in_event_id/check_out_event_id columns to parking_history table!' as message;
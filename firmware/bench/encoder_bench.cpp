@@ -0,0 +1,116 @@
+/*
+📊 Microbenchmark: status payload encoder
+So sánh cách build body + URL cũ (ostringstream + nối string) với StatusEncoder + SlotUrlTable
+- Đếm số lần cấp phát heap mỗi event bằng operator new toàn cục
+- Kiểm tra hai cách cho ra đúng cùng một payload
+Chạy: make bench
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../sim/status_encoder.h"
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+// noinline: để GCC không ghép free() vào chỗ gọi delete rồi báo -Wmismatched-new-delete
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+const std::string API_BASE_URL = "http://localhost:8888/api";
+const int FIRST_SLOT = 1;
+const int SLOTS = 10000;
+const int EVENTS = 1000000;
+
+struct Event {
+    int slotId;
+    bool occupied;
+    int64_t epochMs;
+    float distance;
+};
+
+// Cách cũ trong sendStatusUpdate
+void legacyEncode(const Event& e, std::string& url, std::string& body) {
+    std::ostringstream payload;
+    payload << "{"
+            << "\"status\":\"" << (e.occupied ? "occupied" : "available") << "\","
+            << "\"sensor_id\":\"ESP32_SLOT_" << e.slotId << "\","
+            << "\"timestamp\":" << e.epochMs << ","
+            << "\"distance\":" << std::fixed << std::setprecision(1) << e.distance << ","
+            << "\"simulation\":true"
+            << "}";
+    url = API_BASE_URL + "/slots/" + std::to_string(e.slotId) + "/status";
+    body = payload.str();
+}
+
+template <typename Fn>
+void run(const char* name, const std::vector<Event>& events, Fn encode) {
+    uint64_t before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    for (const Event& e : events) bytes += encode(e);
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocs = allocations.load() - before;
+    std::printf("%-22s %8.1f ns/event  %6.2f allocs/event  (%zu bytes)\n", name, elapsed / events.size(),
+                static_cast<double>(allocs) / events.size(), bytes);
+}
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> slot(FIRST_SLOT, FIRST_SLOT + SLOTS - 1);
+    std::uniform_real_distribution<float> distance(0.0f, 42.0f);
+    std::vector<Event> events(EVENTS);
+    int64_t epochMs = 1762128000000;
+    for (Event& e : events) {
+        e.slotId = slot(gen);
+        e.distance = distance(gen);
+        e.occupied = e.distance <= 10.0f;
+        e.epochMs = (epochMs += 3);
+    }
+
+    SlotUrlTable urls;
+    urls.init(API_BASE_URL, FIRST_SLOT, SLOTS);
+    StatusEncoder encoder;
+
+    // Payload phải giống hệt cách cũ
+    std::string legacyUrl, legacyBody;
+    for (const Event& e : events) {
+        legacyEncode(e, legacyUrl, legacyBody);
+        if (encoder.encode(e.slotId, e.occupied, e.epochMs, e.distance) != legacyBody ||
+            urls.statusUrl(e.slotId) != legacyUrl) {
+            std::printf("❌ Mismatch for slot %d: %s\n", e.slotId, legacyBody.c_str());
+            return 1;
+        }
+    }
+    std::printf("✅ %d payloads identical\n", EVENTS);
+
+    run("ostringstream", events, [&](const Event& e) {
+        legacyEncode(e, legacyUrl, legacyBody);
+        return legacyBody.size() + legacyUrl.size();
+    });
+
+    // body giống HttpCall::body: buffer tái sử dụng, assign không cấp phát khi đủ capacity
+    std::string body;
+    body.reserve(STATUS_PAYLOAD_CAPACITY);
+    run("StatusEncoder", events, [&](const Event& e) {
+        std::string_view payload = encoder.encode(e.slotId, e.occupied, e.epochMs, e.distance);
+        const std::string& url = urls.statusUrl(e.slotId);
+        body.assign(payload.data(), payload.size());
+        return body.size() + url.size();
+    });
+    return 0;
+}
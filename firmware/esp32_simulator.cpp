@@ -12,15 +12,27 @@ Compile và run như một C++ program thông thường
 #include <ctime>
 #include <iomanip>
 #include <sstream>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 
 #ifdef _WIN32
     #include <windows.h>
     #include <wininet.h>
     #pragma comment(lib, "wininet.lib")
-#else
-    #include <curl/curl.h>
 #endif
 
+#include "sim/http_transport.h"
+#include "sim/event_loop.h"
+#include "sim/sim_clock.h"
+#include "sim/trace.h"
+#include "sim/async_log.h"
+#include "sim/status_encoder.h"
+#include "sim/metrics.h"
+#include "sim/arrival.h"
+
 // ============================================================================
 // 📋 CONFIGURATION - Thay đổi theo setup của bạn
 // ============================================================================
@@ -29,6 +41,10 @@ const std::string WIFI_PASSWORD = "YourWiFiPassword";
 const std::string API_BASE_URL = "http://localhost:8888/api";
 const int SLOT_ID = 1;
 
+// JWT cho API: lấy từ env SIM_AUTH_TOKEN, nếu trống thì login bằng tài khoản demo
+const std::string LOGIN_EMAIL = "admin@smartparking.com";
+const std::string LOGIN_PASSWORD = "123456";
+
 // ============================================================================
 // 🎮 SIMULATION SETTINGS
 // ============================================================================
@@ -38,62 +54,161 @@ const float MANUAL_DISTANCE = 25.0f;
 const float DISTANCE_THRESHOLD = 10.0f;
 const int MEASURE_INTERVAL = 3000;  // ms
 const int DEBOUNCE_TIME = 5000;     // ms
+const int MAX_HTTP_RETRIES = 2;     // gửi lại khi lỗi transport/5xx
+
+// ============================================================================
+// 🏙️ FLEET SETTINGS (nhiều slot trong một process)
+// ============================================================================
+const int FLEET_MAX_WORKERS = 8;
+const int FLEET_REPORT_INTERVAL = 10000; // ms
+
+// ============================================================================
+// 🚦 LOAD GENERATOR SETTINGS (open-loop, --load)
+// ============================================================================
+const int LOAD_DEFAULT_SLOTS = 1000;
+const int LOAD_DEFAULT_SECONDS = 60;
+const size_t LOAD_MAX_IN_FLIGHT = 20000;   // vượt ngưỡng thì bỏ request và tính là failed
 
 // ============================================================================
 // 🔄 GLOBAL VARIABLES
 // ============================================================================
-std::chrono::steady_clock::time_point lastMeasurement;
-std::chrono::steady_clock::time_point lastStatusChange;
-bool currentStatus = false;
-bool lastStatus = false;
 bool isConnected = false;
-int simulationStep = 0;
 std::random_device rd;
 std::mt19937 gen(rd());
+bool verboseLog = true;  // fleet mode tắt log từng phép đo
+uint64_t simSeed = 0;    // --seed; cùng seed → cùng chuỗi khoảng cách cho mọi slot
+TraceWriter* traceWriter = nullptr;
+AsyncLogger logger;      // hot path chỉ enqueue record, writer thread lo format + stdout
+SlotUrlTable statusUrls; // URL PUT /slots/:id/status build sẵn cho dải slot đang chạy
+EndpointStats endpointStats[ENDPOINT_COUNT];  // latency + sent/failed/retried theo endpoint
 
 // ============================================================================
 // 🛠️ UTILITY FUNCTIONS
 // ============================================================================
-std::string getCurrentTime() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now.time_since_epoch()) % 1000;
-    
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&time_t), "%H:%M:%S");
-    ss << "." << std::setfill('0') << std::setw(3) << ms.count();
-    return ss.str();
+struct tm toLocalTime(int64_t epochMs) {
+    std::time_t time_t = static_cast<std::time_t>(epochMs / 1000);
+    struct tm timeinfo;
+#ifdef _WIN32
+    localtime_s(&timeinfo, &time_t);
+#else
+    localtime_r(&time_t, &timeinfo);
+#endif
+    return timeinfo;
+}
+
+// Prefix thời gian theo SimClock được gắn lúc enqueue, writer thread format sau
+void log(LogLevel level, const std::string& message) {
+    logger.pushText(level, SimClock::epochMs(), message.data(), message.size());
 }
 
 void log(const std::string& message) {
-    std::cout << "[" << getCurrentTime() << "] " << message << std::endl;
+    log(LOG_INFO, message);
+}
+
+LogLevel parseLogLevel(const std::string& name) {
+    if (name == "debug") return LOG_DEBUG;
+    if (name == "warn") return LOG_WARN;
+    if (name == "error") return LOG_ERROR;
+    return LOG_INFO;
+}
+
+// Formatter của các dòng log mỗi phép đo: chạy trên writer thread, hot path chỉ ghi số
+size_t formatSlotStatus(const LogRecord& record, char* out, size_t capacity) {
+    int n = std::snprintf(out, capacity, "%s [%s] Distance: %.1fcm | Slot %d",
+                          record.b0 ? "🚗" : "🅿️", record.b0 ? "OCCUPIED" : "AVAILABLE",
+                          record.f0, record.i0);
+    return std::min(static_cast<size_t>(std::max(n, 0)), capacity - 1);
+}
+
+size_t formatStatusChanged(const LogRecord& record, char* out, size_t capacity) {
+    int n = std::snprintf(out, capacity, "🔄 Status changed: %s (distance: %fcm)",
+                          record.b0 ? "OCCUPIED" : "AVAILABLE", record.f0);
+    return std::min(static_cast<size_t>(std::max(n, 0)), capacity - 1);
+}
+
+size_t formatStatusSent(const LogRecord& record, char* out, size_t capacity) {
+    int n = std::snprintf(out, capacity, "✅ Status updated successfully! (HTTP %d, %.1fms)",
+                          record.i0, record.f0);
+    return std::min(static_cast<size_t>(std::max(n, 0)), capacity - 1);
+}
+
+// Giờ (0-23) theo SimClock; cache theo từng giờ để fast-forward không gọi localtime mỗi phép đo
+int currentHour() {
+    thread_local int64_t cachedHourStart = -1;
+    thread_local int cachedHour = 0;
+    int64_t epochSeconds = SimClock::epochMs() / 1000;
+    if (cachedHourStart < 0 || epochSeconds < cachedHourStart || epochSeconds >= cachedHourStart + 3600) {
+        struct tm timeinfo = toLocalTime(epochSeconds * 1000);
+        cachedHour = timeinfo.tm_hour;
+        cachedHourStart = epochSeconds - timeinfo.tm_min * 60 - timeinfo.tm_sec;
+    }
+    return cachedHour;
 }
 
 // ============================================================================
-// 🌐 HTTP CLIENT (Simple implementation)
+// 🌐 HTTP CLIENT
 // ============================================================================
 #ifdef _WIN32
-bool sendHTTPRequest(const std::string& url, const std::string& data) {
+HttpResult sendHTTPRequest(const char* method, const std::string& url, std::string_view data) {
     // Windows WinINet implementation
+    (void)method;
+    (void)data;
+    HttpResult result;
     HINTERNET hInternet = InternetOpenA("ESP32Simulator", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
-    if (!hInternet) return false;
+    if (!hInternet) return result;
     
     HINTERNET hConnect = InternetOpenUrlA(hInternet, url.c_str(), NULL, 0, INTERNET_FLAG_RELOAD, 0);
     if (!hConnect) {
         InternetCloseHandle(hInternet);
-        return false;
+        return result;
     }
     
     // For simplicity, just return true
     InternetCloseHandle(hConnect);
     InternetCloseHandle(hInternet);
+    result.ok = true;
+    result.status = 200;
+    return result;
+}
+
+bool loginAndGetToken() {
     return true;
 }
 #else
-// Linux/Mac curl implementation
-bool sendHTTPRequest(const std::string& url, const std::string& data) {
-    // Simplified - would need proper curl implementation
+// Linux/Mac: mỗi thread giữ một HttpTransport (multi handle + pool easy handle theo host)
+HttpTransport& threadTransport() {
+    thread_local HttpTransport transport;
+    return transport;
+}
+
+HttpResult sendHTTPRequest(const char* method, const std::string& url, std::string_view data) {
+    return threadTransport().request(method, url, data);
+}
+
+bool loginAndGetToken() {
+    if (const char* token = std::getenv("SIM_AUTH_TOKEN")) {
+        HttpTransport::setAuthToken(token);
+        return true;
+    }
+
+    std::string body = "{\"email\":\"" + LOGIN_EMAIL + "\",\"password\":\"" + LOGIN_PASSWORD + "\"}";
+    HttpResult result = sendHTTPRequest("POST", API_BASE_URL + "/auth/login", body);
+    if (!result.ok) {
+        log(LOG_ERROR, "❌ Login failed: HTTP " + std::to_string(result.status) + " " + result.error);
+        return false;
+    }
+
+    // {"data":{"token":"..."}} - chỉ cần lấy chuỗi sau key "token"
+    const std::string& payload = threadTransport().lastResponse();
+    size_t key = payload.find("\"token\"");
+    size_t start = (key == std::string::npos) ? key : payload.find('"', payload.find(':', key));
+    if (start == std::string::npos) {
+        log(LOG_ERROR, "❌ Login response has no token");
+        return false;
+    }
+    start++;
+    HttpTransport::setAuthToken(payload.substr(start, payload.find('"', start) - start));
+    log("✅ Login OK (" + std::to_string(static_cast<int>(result.latencyMs)) + "ms)");
     return true;
 }
 #endif
@@ -105,6 +220,7 @@ bool connectWiFi() {
     log("📡 Connecting to WiFi '" + WIFI_SSID + "'");
     
     // Simulate connection delay
+    logger.flush();
     for (int i = 0; i < 5; i++) {
         std::cout << ".";
         std::this_thread::sleep_for(std::chrono::milliseconds(500));
@@ -116,6 +232,29 @@ bool connectWiFi() {
     return true;
 }
 
+// ============================================================================
+// 🎲 DETERMINISTIC RNG
+// ============================================================================
+// SplitMix64 khởi tạo từ (seed, slot, step): khoảng cách chỉ phụ thuộc seed chứ không
+// phụ thuộc số worker hay thứ tự thread chạy
+struct SlotRng {
+    using result_type = uint64_t;
+    uint64_t state;
+
+    SlotRng(uint64_t seed, uint32_t slotId, uint32_t step)
+        : state(seed ^ (static_cast<uint64_t>(slotId) << 32) ^ step) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
 // ============================================================================
 // 📏 DISTANCE MEASUREMENT SIMULATION
 // ============================================================================
@@ -128,45 +267,41 @@ float measureDistance() {
     return static_cast<float>(dis(gen));
 }
 
-float simulateDistance() {
+// hour/step/rng được truyền vào để mỗi worker của fleet dùng RNG riêng
+float simulateDistance(int hour, int step, SlotRng& rng) {
     if (!AUTO_MODE) {
         return MANUAL_DISTANCE;
     }
     
     // Auto mode - realistic parking patterns
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    struct tm* timeinfo = std::localtime(&time_t);
-    
-    int hour = timeinfo->tm_hour;
     float distance;
     
     // Rush hours (7-9 AM, 5-7 PM) - more occupied
     if ((hour >= 7 && hour <= 9) || (hour >= 17 && hour <= 19)) {
         // 70% chance of occupied during rush hour
-        if ((simulationStep % 10) < 7) {
+        if ((step % 10) < 7) {
             std::uniform_real_distribution<> dis(3.0, 8.0);
-            distance = static_cast<float>(dis(gen));  // Car present
+            distance = static_cast<float>(dis(rng));  // Car present
         } else {
             std::uniform_real_distribution<> dis(15.0, 40.0);
-            distance = static_cast<float>(dis(gen)); // No car
+            distance = static_cast<float>(dis(rng)); // No car
         }
     }
     // Normal hours - less occupied
     else {
         // 30% chance of occupied during normal hours
-        if ((simulationStep % 10) < 3) {
+        if ((step % 10) < 3) {
             std::uniform_real_distribution<> dis(3.0, 8.0);
-            distance = static_cast<float>(dis(gen));   // Car present
+            distance = static_cast<float>(dis(rng));   // Car present
         } else {
             std::uniform_real_distribution<> dis(15.0, 40.0);
-            distance = static_cast<float>(dis(gen)); // No car
+            distance = static_cast<float>(dis(rng)); // No car
         }
     }
     
     // Add some noise for realism
     std::uniform_real_distribution<> noise(-2.0, 2.0);
-    distance += static_cast<float>(noise(gen));
+    distance += static_cast<float>(noise(rng));
     
     return std::max(0.0f, distance);
 }
@@ -174,37 +309,71 @@ float simulateDistance() {
 // ============================================================================
 // 📤 SEND API UPDATE
 // ============================================================================
-bool sendStatusUpdate(bool occupied, float distance) {
+// Request chạy trên EventLoop của worker; done(result) được gọi khi có kết quả
+void submitHTTPRequest(EventLoop& loop, const char* method, const std::string& url,
+                       std::string_view data, HttpCallback done) {
+#ifdef SIM_HAS_EPOLL
+    loop.transport().submit(method, url, data, std::move(done));
+#else
+    (void)loop;
+    done(sendHTTPRequest(method, url, data));
+#endif
+}
+
+// Ghi latency của mọi response nhận được (kể cả lần thử lại); lỗi transport chỉ tính vào failed
+void recordLatency(Endpoint endpoint, const HttpResult& result) {
+    if (result.status != 0) {
+        endpointStats[endpoint].latency.record(static_cast<uint64_t>(result.latencyMs * 1000.0));
+    }
+}
+
+bool shouldRetry(const HttpResult& result, int attempt) {
+    return !result.ok && (result.status == 0 || result.status >= 500) && attempt < MAX_HTTP_RETRIES;
+}
+
+void sendStatusUpdate(EventLoop& loop, int slotId, bool occupied, float distance, HttpCallback done,
+                      int attempt = 0) {
     if (!isConnected) {
-        log("📡 Offline mode - status not sent");
-        return false;
+        if (verboseLog) log("📡 Offline mode - status not sent");
+        done(HttpResult());
+        return;
     }
     
-    // Create JSON payload
-    std::ostringstream payload;
-    payload << "{"
-            << "\"status\":\"" << (occupied ? "occupied" : "available") << "\","
-            << "\"sensor_id\":\"ESP32_SLOT_" << SLOT_ID << "\","
-            << "\"timestamp\":" << std::chrono::duration_cast<std::chrono::milliseconds>(
-                   std::chrono::system_clock::now().time_since_epoch()).count() << ","
-            << "\"distance\":" << std::fixed << std::setprecision(1) << distance << ","
-            << "\"simulation\":true"
-            << "}";
+    // Create JSON payload: encoder của thread, transport copy body vào buffer của request
+    thread_local StatusEncoder encoder;
+    std::string_view payload = encoder.encode(slotId, occupied, SimClock::epochMs(), distance);
+    const std::string& url = statusUrls.statusUrl(slotId);
     
-    std::string url = API_BASE_URL + "/slots/" + std::to_string(SLOT_ID) + "/status";
+    if (verboseLog) log("📤 Sending: " + std::string(payload));
     
-    log("📤 Sending: " + payload.str());
-    
-    // Simulate API call
-    bool success = sendHTTPRequest(url, payload.str());
-    
-    if (success) {
-        log("✅ Status updated successfully!");
-        return true;
-    } else {
-        log("❌ HTTP error: Connection failed");
-        return false;
-    }
+    submitHTTPRequest(loop, "PUT", url, payload, [&loop, slotId, occupied, distance, attempt,
+                                                  done = std::move(done)](const HttpResult& result) mutable {
+        EndpointStats& stats = endpointStats[ENDPOINT_STATUS];
+        recordLatency(ENDPOINT_STATUS, result);
+        if (shouldRetry(result, attempt)) {
+            stats.retried.fetch_add(1, std::memory_order_relaxed);
+            sendStatusUpdate(loop, slotId, occupied, distance, std::move(done), attempt + 1);
+            return;
+        }
+
+        if (result.ok) {
+            stats.sent.fetch_add(1, std::memory_order_relaxed);
+            if (verboseLog) {
+                logger.push(LOG_INFO, SimClock::epochMs(), [&](LogRecord& record) {
+                    record.format = formatStatusSent;
+                    record.i0 = static_cast<int32_t>(result.status);
+                    record.f0 = static_cast<float>(result.latencyMs);
+                });
+            }
+        } else if (result.status == 0) {
+            stats.failed.fetch_add(1, std::memory_order_relaxed);
+            log(LOG_ERROR, "❌ HTTP error: " + result.error + " (slot " + std::to_string(slotId) + ")");
+        } else {
+            stats.failed.fetch_add(1, std::memory_order_relaxed);
+            log(LOG_ERROR, "❌ HTTP " + std::to_string(result.status) + " (slot " + std::to_string(slotId) + "): " + result.error);
+        }
+        done(result);
+    });
 }
 
 // ============================================================================
@@ -220,14 +389,13 @@ void printHeader() {
     std::cout << "===============================================" << std::endl;
 }
 
-void printStatus(float distance, bool occupied) {
-    std::string statusIcon = occupied ? "🚗" : "🅿️";
-    std::string statusText = occupied ? "OCCUPIED" : "AVAILABLE";
-    
-    std::ostringstream ss;
-    ss << statusIcon << " [" << statusText << "] Distance: " 
-       << std::fixed << std::setprecision(1) << distance << "cm | Slot " << SLOT_ID;
-    log(ss.str());
+void printStatus(int slotId, float distance, bool occupied) {
+    logger.push(LOG_INFO, SimClock::epochMs(), [&](LogRecord& record) {
+        record.format = formatSlotStatus;
+        record.i0 = slotId;
+        record.f0 = distance;
+        record.b0 = occupied;
+    });
 }
 
 void printSystemInfo() {
@@ -248,8 +416,11 @@ void handleCommands() {
     std::string command;
     
     while (true) {
+        logger.flush();
         std::cout << "\n🎮 Commands (info/memory/distance X/help/quit): ";
-        std::getline(std::cin, command);
+        if (!std::getline(std::cin, command)) {
+            return;  // stdin đóng (chạy nền/load test) → bỏ command handler
+        }
         
         if (command == "quit" || command == "exit") {
             log("👋 Goodbye!");
@@ -264,7 +435,7 @@ void handleCommands() {
                 log("🔧 Manual distance set to " + std::to_string(newDistance) + " cm");
                 // In real implementation, would update manual distance
             } catch (const std::exception&) {
-                log("❌ Invalid distance format");
+                log(LOG_WARN, "❌ Invalid distance format");
             }
         } else if (command == "help") {
             log("📝 Available commands:");
@@ -274,70 +445,670 @@ void handleCommands() {
             log("   quit     - Exit simulator");
             log("   help     - This help message");
         } else if (!command.empty()) {
-            log("❌ Unknown command: " + command);
+            log(LOG_WARN, "❌ Unknown command: " + command);
         }
     }
 }
 
 // ============================================================================
-// 🔄 MAIN LOOP
+// 🏙️ FLEET MODE - hàng nghìn slot ảo trong một process
 // ============================================================================
-void mainLoop() {
-    lastMeasurement = std::chrono::steady_clock::now();
-    lastStatusChange = std::chrono::steady_clock::now();
-    
-    while (true) {
-        auto now = std::chrono::steady_clock::now();
-        
-        // Measure distance every MEASURE_INTERVAL
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastMeasurement).count() >= MEASURE_INTERVAL) {
-            float distance;
-            
-            if (SIMULATION_MODE) {
-                distance = simulateDistance();
-            } else {
-                distance = measureDistance();
-            }
-            
-            currentStatus = (distance <= DISTANCE_THRESHOLD);
-            
-            // Print current status
-            printStatus(distance, currentStatus);
-            
-            // Check for status change with debounce
-            if (currentStatus != lastStatus) {
-                if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastStatusChange).count() >= DEBOUNCE_TIME) {
-                    std::string statusText = currentStatus ? "OCCUPIED" : "AVAILABLE";
-                    log("🔄 Status changed: " + statusText + " (distance: " + 
-                        std::to_string(distance) + "cm)");
-                    
-                    // Send to API
-                    if (sendStatusUpdate(currentStatus, distance)) {
-                        lastStatus = currentStatus;
-                        lastStatusChange = now;
-                    }
+// Trạng thái per-slot lưu dạng struct-of-arrays liên tục: vòng quét của worker
+// chỉ chạm vào các mảng nó cần (nextMeasureMs khi tìm slot đến hạn).
+struct SlotTable {
+    std::vector<int> slotId;
+    std::vector<float> distance;
+    std::vector<uint8_t> currentStatus;
+    std::vector<uint8_t> lastStatus;
+    std::vector<int64_t> lastStatusChangeMs;
+    std::vector<int64_t> nextMeasureMs;
+    std::vector<uint32_t> simulationStep;
+    std::vector<uint8_t> inFlight;      // đang chờ response của sendStatusUpdate
+
+    void init(int firstSlotId, int count, int64_t startMs) {
+        slotId.resize(count);
+        distance.assign(count, 0.0f);
+        currentStatus.assign(count, 0);
+        lastStatus.assign(count, 0);
+        lastStatusChangeMs.assign(count, startMs);
+        nextMeasureMs.resize(count);
+        simulationStep.assign(count, 0);
+        inFlight.assign(count, 0);
+        for (int i = 0; i < count; i++) {
+            slotId[i] = firstSlotId + i;
+            // Rải đều lần đo đầu tiên trong một MEASURE_INTERVAL để tránh burst
+            nextMeasureMs[i] = startMs + (static_cast<int64_t>(i) * MEASURE_INTERVAL) / count;
+        }
+    }
+
+    size_t size() const { return slotId.size(); }
+};
+
+struct FleetStats {
+    std::atomic<uint64_t> measurements{0};
+    std::atomic<uint64_t> transitions{0};
+    std::atomic<uint64_t> debounced{0};   // đổi trạng thái nhưng còn trong DEBOUNCE_TIME
+    std::atomic<int64_t> occupied{0};     // số slot có lastStatus = 1; worker cập nhật khi đổi, reporter chỉ đọc
+};
+
+struct SimOptions {
+    int slots = 0;          // 0 = single-slot mode cũ
+    int firstSlotId = SLOT_ID;
+    int workers = 0;        // 0 = tự chọn theo số core
+    double speed = 1.0;     // hệ số tăng tốc của SimClock, 0 = fast-forward
+    int64_t startEpochMs = 0;
+    int64_t durationMs = 0; // thời gian ảo cần mô phỏng, 0 = chạy mãi
+    bool hasSeed = false;
+    uint64_t seed = 0;
+    std::string tracePath;
+    std::string replayPath;
+    int metricsPort = 0;    // 0 = không mở endpoint Prometheus
+    double loadRate = 0;    // req/s của load generator, 0 = tắt
+    double rampFrom = 0;    // --arrival ramp: rate lúc bắt đầu
+    ArrivalPattern arrival = ARRIVAL_CONSTANT;
+    int loadSeconds = LOAD_DEFAULT_SECONDS;
+    int mix[ENDPOINT_COUNT] = {80, 10, 10};  // tỉ lệ status:checkin:checkout
+};
+
+SlotTable fleet;
+FleetStats fleetStats;
+int64_t simStartMs = 0;
+
+// ============================================================================
+// 📈 METRICS - latency theo endpoint, báo cáo khi thoát và endpoint Prometheus
+// ============================================================================
+void printLatencyReport() {
+    log("📈 Latency (ms)   count      p50      p90      p99    p99.9      max |   sent failed retried");
+    for (int e = 0; e < ENDPOINT_COUNT; e++) {
+        const EndpointStats& stats = endpointStats[e];
+        const LatencyHistogram& h = stats.latency;
+        char line[192];
+        std::snprintf(line, sizeof(line), "   %-10s %9llu %8.1f %8.1f %8.1f %8.1f %8.1f | %6llu %6llu %7llu",
+                      endpointName(static_cast<Endpoint>(e)), static_cast<unsigned long long>(h.count()),
+                      h.percentileUs(0.5) / 1000.0, h.percentileUs(0.9) / 1000.0,
+                      h.percentileUs(0.99) / 1000.0, h.percentileUs(0.999) / 1000.0, h.maxUs() / 1000.0,
+                      static_cast<unsigned long long>(stats.sent.load()),
+                      static_cast<unsigned long long>(stats.failed.load()),
+                      static_cast<unsigned long long>(stats.retried.load()));
+        log(line);
+    }
+    log("   measurements " + std::to_string(fleetStats.measurements.load()) +
+        " | transitions " + std::to_string(fleetStats.transitions.load()) +
+        " | debounced " + std::to_string(fleetStats.debounced.load()));
+}
+
+// Text format 0.0.4 cho Prometheus (job esp32-simulator trong monitoring/prometheus)
+std::string renderMetrics() {
+    std::string out;
+    out += "# HELP smartparking_sim_requests_total HTTP requests finished by the simulator (after retries)\n";
+    out += "# TYPE smartparking_sim_requests_total counter\n";
+    for (int e = 0; e < ENDPOINT_COUNT; e++) {
+        const char* name = endpointName(static_cast<Endpoint>(e));
+        out += "smartparking_sim_requests_total{endpoint=\"" + std::string(name) + "\",result=\"sent\"} " +
+               std::to_string(endpointStats[e].sent.load()) + "\n";
+        out += "smartparking_sim_requests_total{endpoint=\"" + std::string(name) + "\",result=\"failed\"} " +
+               std::to_string(endpointStats[e].failed.load()) + "\n";
+    }
+    out += "# HELP smartparking_sim_retries_total HTTP requests sent again after a transport error or 5xx\n";
+    out += "# TYPE smartparking_sim_retries_total counter\n";
+    for (int e = 0; e < ENDPOINT_COUNT; e++) {
+        out += "smartparking_sim_retries_total{endpoint=\"" + std::string(endpointName(static_cast<Endpoint>(e))) +
+               "\"} " + std::to_string(endpointStats[e].retried.load()) + "\n";
+    }
+    out += "# HELP smartparking_sim_request_latency_seconds HTTP response latency per endpoint\n";
+    out += "# TYPE smartparking_sim_request_latency_seconds summary\n";
+    for (int e = 0; e < ENDPOINT_COUNT; e++) {
+        appendPrometheusSummary(out, "smartparking_sim_request_latency_seconds",
+                                endpointName(static_cast<Endpoint>(e)), endpointStats[e].latency);
+    }
+    out += "# TYPE smartparking_sim_measurements_total counter\n";
+    out += "smartparking_sim_measurements_total " + std::to_string(fleetStats.measurements.load()) + "\n";
+    out += "# TYPE smartparking_sim_transitions_total counter\n";
+    out += "smartparking_sim_transitions_total " + std::to_string(fleetStats.transitions.load()) + "\n";
+    out += "# TYPE smartparking_sim_debounced_total counter\n";
+    out += "smartparking_sim_debounced_total " + std::to_string(fleetStats.debounced.load()) + "\n";
+    out += "# TYPE smartparking_sim_slots gauge\n";
+    out += "smartparking_sim_slots " + std::to_string(fleet.size()) + "\n";
+    return out;
+}
+
+void traceEvent(int64_t epochMs, int slotId, float distance, uint8_t event, const HttpResult* result) {
+    if (!traceWriter) return;
+    TraceRecord record{};
+    record.timestampMs = epochMs;
+    record.slotId = static_cast<uint32_t>(slotId);
+    record.distance = distance;
+    record.event = event;
+    if (result) {
+        record.status = static_cast<uint16_t>(result->status);
+        record.latencyUs = static_cast<uint32_t>(result->latencyMs * 1000.0);
+    }
+    traceWriter->append(record);
+}
+
+// Đưa một slot qua pipeline simulateDistance → hysteresis/debounce → sendStatusUpdate
+void stepSlot(EventLoop& loop, size_t i, int64_t nowMs, int hour) {
+    SlotRng rng(simSeed, fleet.slotId[i], fleet.simulationStep[i]);
+    float distance = SIMULATION_MODE ? simulateDistance(hour, fleet.simulationStep[i], rng)
+                                     : measureDistance();
+    bool occupied = (distance <= DISTANCE_THRESHOLD);
+    int64_t epochMs = SimClock::epochMs();
+    fleet.distance[i] = distance;
+    fleet.currentStatus[i] = occupied;
+    fleetStats.measurements.fetch_add(1, std::memory_order_relaxed);
+    traceEvent(epochMs, fleet.slotId[i], distance, TRACE_MEASURE, nullptr);
+
+    if (verboseLog) printStatus(fleet.slotId[i], distance, occupied);
+
+    // Slot đang có request chưa xong thì chờ kết quả rồi mới xét transition tiếp
+    bool changed = !fleet.inFlight[i] && occupied != (fleet.lastStatus[i] != 0);
+    if (changed && nowMs - fleet.lastStatusChangeMs[i] < DEBOUNCE_TIME) {
+        fleetStats.debounced.fetch_add(1, std::memory_order_relaxed);
+    } else if (changed) {
+        if (verboseLog) {
+            logger.push(LOG_INFO, epochMs, [&](LogRecord& record) {
+                record.format = formatStatusChanged;
+                record.f0 = distance;
+                record.b0 = occupied;
+            });
+        }
+        fleetStats.transitions.fetch_add(1, std::memory_order_relaxed);
+        fleet.inFlight[i] = 1;
+        sendStatusUpdate(loop, fleet.slotId[i], occupied, distance,
+                         [i, occupied, distance, nowMs, epochMs](const HttpResult& result) {
+            fleet.inFlight[i] = 0;
+            traceEvent(epochMs, fleet.slotId[i], distance, occupied ? TRACE_OCCUPIED : TRACE_AVAILABLE, &result);
+            if (result.ok) {
+                if (fleet.lastStatus[i] != occupied) {
+                    fleetStats.occupied.fetch_add(occupied ? 1 : -1, std::memory_order_relaxed);
                 }
+                fleet.lastStatus[i] = occupied;
+                fleet.lastStatusChangeMs[i] = nowMs;
             }
-            
-            lastMeasurement = now;
-            simulationStep++;
+        });
+    }
+
+    fleet.nextMeasureMs[i] = nowMs + MEASURE_INTERVAL;
+    fleet.simulationStep[i]++;
+    loop.schedule(fleet.nextMeasureMs[i], static_cast<uint32_t>(i));
+}
+
+// Mỗi worker sở hữu một dải slot liên tục [begin, end) và một EventLoop riêng nên không cần lock
+void runSlots(size_t begin, size_t end, int64_t untilMs) {
+    EventLoop* loopPtr = nullptr;
+    EventLoop loop([&](uint32_t id, int64_t nowMs) {
+        stepSlot(*loopPtr, id, nowMs, currentHour());
+    });
+    loopPtr = &loop;
+    loop.setFastForwardWindow(MEASURE_INTERVAL);
+
+    for (size_t i = begin; i < end; i++) {
+        loop.schedule(fleet.nextMeasureMs[i], static_cast<uint32_t>(i));
+    }
+    loop.run(untilMs);
+}
+
+int64_t simUntilMs(const SimOptions& options, int64_t startMs) {
+    return options.durationMs > 0 ? startMs + options.durationMs : -1;
+}
+
+// Single-slot mode: một EventLoop trên main thread cho SLOT_ID
+void mainLoop(const SimOptions& options) {
+    int64_t startMs = SimClock::nowMs();
+    fleet.init(SLOT_ID, 1, startMs);
+    statusUrls.init(API_BASE_URL, SLOT_ID, 1);
+    fleet.nextMeasureMs[0] += MEASURE_INTERVAL;
+    runSlots(0, 1, simUntilMs(options, startMs));
+}
+
+void printFleetReport(int64_t elapsedMs, double cpuSeconds) {
+    int64_t occupied = fleetStats.occupied.load(std::memory_order_relaxed);
+
+    double wallSeconds = elapsedMs / 1000.0;
+    double cpuPercent = wallSeconds > 0 ? 100.0 * cpuSeconds / wallSeconds : 0.0;
+    double perThousand = cpuPercent * 1000.0 / static_cast<double>(fleet.size());
+    const EndpointStats& status = endpointStats[ENDPOINT_STATUS];
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2)
+       << "📊 Fleet: " << fleet.size() << " slots | occupied " << occupied
+       << " | measurements " << fleetStats.measurements.load()
+       << " | transitions " << fleetStats.transitions.load()
+       << " | debounced " << fleetStats.debounced.load()
+       << " | sent " << status.sent.load()
+       << " | failed " << status.failed.load()
+       << " | retried " << status.retried.load()
+       << std::setprecision(1)
+       << " | p50 " << status.latency.percentileUs(0.5) / 1000.0
+       << "ms p99 " << status.latency.percentileUs(0.99) / 1000.0 << "ms"
+       << std::setprecision(2)
+       << " | CPU " << cpuPercent << "% (" << perThousand << "%/1k slots)";
+    if (SimClock::speed() != 1.0) {
+        ss << " | sim " << (SimClock::nowMs() - simStartMs) / 3600000.0 << "h";
+    }
+    log(ss.str());
+}
+
+void runFleet(const SimOptions& options) {
+    simStartMs = SimClock::nowMs();
+    fleet.init(options.firstSlotId, options.slots, simStartMs);
+    statusUrls.init(API_BASE_URL, options.firstSlotId, options.slots);
+
+    int workers = options.workers;
+    if (workers <= 0) {
+        workers = static_cast<int>(std::thread::hardware_concurrency());
+        workers = std::max(1, std::min(workers, FLEET_MAX_WORKERS));
+    }
+    workers = std::min(workers, options.slots);
+
+    log("🏙️ Fleet mode: " + std::to_string(options.slots) + " slots (" +
+        std::to_string(options.firstSlotId) + ".." +
+        std::to_string(options.firstSlotId + options.slots - 1) + ") on " +
+        std::to_string(workers) + " workers");
+
+    std::atomic<int> running{0};
+    std::vector<std::thread> threads;
+    size_t chunk = (fleet.size() + workers - 1) / workers;
+    for (int w = 0; w < workers; w++) {
+        size_t begin = w * chunk;
+        size_t end = std::min(fleet.size(), begin + chunk);
+        if (begin >= end) break;
+        running++;
+        threads.emplace_back([begin, end, &options, &running] {
+            runSlots(begin, end, simUntilMs(options, simStartMs));
+            running--;
+        });
+    }
+
+    std::clock_t lastCpu = std::clock();
+    int64_t lastReport = SimClock::realMs();
+    while (running > 0) {
+        int64_t nextReport = lastReport + FLEET_REPORT_INTERVAL;
+        while (running > 0 && SimClock::realMs() < nextReport) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::clock_t cpu = std::clock();
+        int64_t nowMs = SimClock::realMs();
+        printFleetReport(nowMs - lastReport, static_cast<double>(cpu - lastCpu) / CLOCKS_PER_SEC);
+        lastCpu = cpu;
+        lastReport = nowMs;
+    }
+
+    for (std::thread& t : threads) t.join();
+    log("🏁 Fleet simulation finished");
+}
+
+// ============================================================================
+// 🎞️ REPLAY MODE - phát lại status update từ file trace
+// ============================================================================
+// File ghi theo thứ tự ghi xong, không theo timestamp: mỗi worker fleet có đồng hồ ảo riêng (--speed max
+// chạy lệch nhau) và status record chỉ được append khi HTTP trả về. Nên quét một lượt lấy riêng status
+// record (bỏ TRACE_MEASURE, phần lớn file) rồi stable_sort theo timestamp; một EventLoop phát lại theo
+// thứ tự đó, mỗi lần chỉ giữ một timer cho record kế tiếp
+void runReplay(TraceReader& reader) {
+    const int64_t virtualStartMs = SimClock::nowMs();
+    const int64_t epochStartMs = reader.header().startEpochMs;
+    std::vector<TraceRecord> records;
+    TraceRecord scanned{};
+    uint64_t outOfOrder = 0;
+    while (reader.next(scanned)) {
+        if (scanned.event == TRACE_MEASURE) continue;
+        if (!records.empty() && scanned.timestampMs < records.back().timestampMs) outOfOrder++;
+        records.push_back(scanned);
+    }
+    std::stable_sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b) {
+        return a.timestampMs < b.timestampMs;
+    });
+    if (outOfOrder > 0) {
+        log("🎞️ Sorted " + std::to_string(records.size()) + " status updates by timestamp (" +
+            std::to_string(outOfOrder) + " out of order in file)");
+    }
+
+    size_t cursor = 0;
+    TraceRecord record{};
+    uint64_t replayed = 0;
+    statusUrls.init(API_BASE_URL, 0, 0);  // slot ID lấy từ trace → URL build theo từng request
+
+    EventLoop* loopPtr = nullptr;
+    auto scheduleNext = [&]() {
+        if (cursor >= records.size()) return;
+        record = records[cursor++];
+        loopPtr->schedule(virtualStartMs + (record.timestampMs - epochStartMs), 0);
+    };
+
+    EventLoop loop([&](uint32_t, int64_t) {
+        TraceRecord current = record;
+        bool occupied = (current.event == TRACE_OCCUPIED);
+        int64_t epochMs = SimClock::epochMs();
+        fleetStats.transitions.fetch_add(1, std::memory_order_relaxed);
+        sendStatusUpdate(*loopPtr, current.slotId, occupied, current.distance,
+                         [current, occupied, epochMs](const HttpResult& result) {
+            traceEvent(epochMs, current.slotId, current.distance,
+                       occupied ? TRACE_OCCUPIED : TRACE_AVAILABLE, &result);
+        });
+        if (++replayed % 100000 == 0) {
+            log("🎞️ Replayed " + std::to_string(replayed) + " status updates");
+        }
+        scheduleNext();
+    });
+    loopPtr = &loop;
+    loop.setFastForwardWindow(MEASURE_INTERVAL);
+
+    scheduleNext();
+    loop.run();
+    log("🏁 Replay finished: " + std::to_string(replayed) + " updates | sent " +
+        std::to_string(endpointStats[ENDPOINT_STATUS].sent.load()) + " | failed " +
+        std::to_string(endpointStats[ENDPOINT_STATUS].failed.load()));
+}
+
+// ============================================================================
+// 🚦 LOAD GENERATOR MODE - open-loop theo arrival rate cố định
+// ============================================================================
+// Latency = lúc nhận response - thời điểm lẽ ra phải gửi theo lịch (không phải lúc thực sự
+// gửi), nên khi backend chậm và request bị dồn, thời gian chờ vẫn được tính (coordinated omission)
+LatencyHistogram serviceLatency[ENDPOINT_COUNT];  // latency curl tự đo, chỉ để so sánh
+std::atomic<uint64_t> loadIssued{0};
+std::atomic<uint64_t> loadSkipped{0};
+
+void issueLoadRequest(EventLoop& loop, Endpoint endpoint, int slotId, int64_t intendedUs, SlotRng& rng) {
+    EndpointStats& stats = endpointStats[endpoint];
+    loadIssued.fetch_add(1, std::memory_order_relaxed);
+    if (loop.inFlight() >= LOAD_MAX_IN_FLIGHT) {
+        // Không gửi được = client chờ tới timeout: ghi mẫu bão hoà để p99 không đẹp giả khi quá tải
+        int64_t waitedUs = std::max<int64_t>(SimClock::realUs() - intendedUs, HTTP_TIMEOUT_MS * 1000);
+        stats.latency.record(static_cast<uint64_t>(waitedUs));
+        loadSkipped.fetch_add(1, std::memory_order_relaxed);
+        stats.failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Request không retry: mỗi lần gửi lại sẽ là tải ngoài lịch
+    HttpCallback done = [endpoint, intendedUs](const HttpResult& result) {
+        EndpointStats& stats = endpointStats[endpoint];
+        // Mọi lần kết thúc đều ghi, kể cả timeout / lỗi transport (status 0): bỏ chúng là coordinated omission
+        stats.latency.record(static_cast<uint64_t>(std::max<int64_t>(SimClock::realUs() - intendedUs, 0)));
+        serviceLatency[endpoint].record(static_cast<uint64_t>(result.latencyMs * 1000.0));
+        if (result.ok) {
+            stats.sent.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        stats.failed.fetch_add(1, std::memory_order_relaxed);
+        if (logger.enabled(LOG_DEBUG)) {
+            log(LOG_DEBUG, "❌ " + std::string(endpointName(endpoint)) + ": HTTP " +
+                std::to_string(result.status) + " " + result.error);
+        }
+    };
+
+    static const std::string checkInUrl = API_BASE_URL + "/parking/checkin";
+    static const std::string checkOutUrl = API_BASE_URL + "/parking/checkout";
+    thread_local StatusEncoder encoder;
+    if (endpoint == ENDPOINT_CHECKIN) {
+        submitHTTPRequest(loop, "POST", checkInUrl, encoder.encodeCheckIn(slotId), std::move(done));
+    } else if (endpoint == ENDPOINT_CHECKOUT) {
+        submitHTTPRequest(loop, "POST", checkOutUrl, encoder.encodeCheckOut(slotId), std::move(done));
+    } else {
+        std::uniform_real_distribution<float> dis(3.0f, 40.0f);
+        float distance = dis(rng);
+        submitHTTPRequest(loop, "PUT", statusUrls.statusUrl(slotId),
+                          encoder.encode(slotId, distance <= DISTANCE_THRESHOLD, SimClock::epochMs(), distance),
+                          std::move(done));
+    }
+}
+
+void runLoadWorker(const SimOptions& options, int worker, int workers, int64_t startUs) {
+    const int64_t durationUs = static_cast<int64_t>(options.loadSeconds) * 1000000;
+    ArrivalSchedule schedule(options.arrival, options.loadRate / workers, options.rampFrom / workers, durationUs);
+    SlotRng rng(simSeed, 0xFFFF0000u + static_cast<uint32_t>(worker), 0);
+    std::uniform_int_distribution<int> slotDist(options.firstSlotId, options.firstSlotId + options.slots - 1);
+    int mixTotal = options.mix[ENDPOINT_STATUS] + options.mix[ENDPOINT_CHECKIN] + options.mix[ENDPOINT_CHECKOUT];
+    std::uniform_int_distribution<int> mixDist(0, mixTotal - 1);
+
+    // Các worker lệch pha nhau một phần khoảng cách để tổng tải vẫn đều
+    double nextUs = (options.arrival == ARRIVAL_POISSON) ? schedule.next(0.0, rng)
+                                                         : (schedule.next(0.0, rng) * worker) / workers;
+
+    EventLoop* loopPtr = nullptr;
+    EventLoop loop([&](uint32_t, int64_t) {
+        int64_t elapsedUs = SimClock::realUs() - startUs;
+        while (nextUs <= elapsedUs && nextUs < durationUs) {
+            int pick = mixDist(rng);
+            Endpoint endpoint = pick < options.mix[ENDPOINT_STATUS] ? ENDPOINT_STATUS
+                              : pick < options.mix[ENDPOINT_STATUS] + options.mix[ENDPOINT_CHECKIN] ? ENDPOINT_CHECKIN
+                              : ENDPOINT_CHECKOUT;
+            int64_t intendedUs = startUs + static_cast<int64_t>(nextUs);
+            issueLoadRequest(*loopPtr, endpoint, slotDist(rng), intendedUs, rng);
+            nextUs = schedule.next(nextUs, rng);
+        }
+        if (nextUs < durationUs) {
+            loopPtr->schedule((startUs + static_cast<int64_t>(nextUs) + 999) / 1000, 0);
+        }
+    });
+    loopPtr = &loop;
+    loop.schedule((startUs + static_cast<int64_t>(nextUs) + 999) / 1000, 0);
+    loop.run();
+}
+
+void printLoadReport(const SimOptions& options, int64_t elapsedUs, uint64_t issuedInWindow, double windowSeconds) {
+    const LatencyHistogram& corrected = endpointStats[ENDPOINT_STATUS].latency;
+    uint64_t sent = 0;
+    uint64_t failed = 0;
+    for (const EndpointStats& stats : endpointStats) {
+        sent += stats.sent.load();
+        failed += stats.failed.load();
+    }
+    ArrivalSchedule schedule(options.arrival, options.loadRate, options.rampFrom,
+                             static_cast<int64_t>(options.loadSeconds) * 1000000);
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1)
+       << "🚦 Load: target " << schedule.rateAt(static_cast<double>(elapsedUs)) << " req/s"
+       << " | actual " << (windowSeconds > 0 ? issuedInWindow / windowSeconds : 0.0) << " req/s"
+       << " | sent " << sent << " | failed " << failed << " | skipped " << loadSkipped.load()
+       << " | status p50 " << corrected.percentileUs(0.5) / 1000.0
+       << "ms p99 " << corrected.percentileUs(0.99) / 1000.0
+       << "ms (service p99 " << serviceLatency[ENDPOINT_STATUS].percentileUs(0.99) / 1000.0 << "ms)";
+    log(ss.str());
+}
+
+void runLoad(const SimOptions& options) {
+    statusUrls.init(API_BASE_URL, options.firstSlotId, options.slots);
+
+    int workers = options.workers;
+    if (workers <= 0) {
+        workers = static_cast<int>(std::thread::hardware_concurrency());
+        workers = std::max(1, std::min(workers, FLEET_MAX_WORKERS));
+    }
+
+    static const char* PATTERN_NAMES[] = {"constant", "poisson", "ramp"};
+    std::ostringstream ss;
+    ss << "🚦 Load generator: " << PATTERN_NAMES[options.arrival] << " ";
+    if (options.arrival == ARRIVAL_RAMP) ss << options.rampFrom << "→";
+    ss << options.loadRate << " req/s for " << options.loadSeconds << "s | mix status:checkin:checkout "
+       << options.mix[ENDPOINT_STATUS] << ":" << options.mix[ENDPOINT_CHECKIN] << ":"
+       << options.mix[ENDPOINT_CHECKOUT] << " | slots " << options.firstSlotId << ".."
+       << options.firstSlotId + options.slots - 1 << " | " << workers << " workers";
+    log(ss.str());
+
+    const int64_t startUs = SimClock::realUs() + 100000;  // chờ các worker sẵn sàng
+    std::atomic<int> running{0};
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; w++) {
+        running++;
+        threads.emplace_back([w, workers, startUs, &options, &running] {
+            runLoadWorker(options, w, workers, startUs);
+            running--;
+        });
+    }
+
+    uint64_t lastIssued = 0;
+    int64_t lastReport = SimClock::realMs();
+    while (running > 0) {
+        int64_t nextReport = lastReport + FLEET_REPORT_INTERVAL;
+        while (running > 0 && SimClock::realMs() < nextReport) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        int64_t nowMs = SimClock::realMs();
+        uint64_t issued = loadIssued.load();
+        printLoadReport(options, SimClock::realUs() - startUs, issued - lastIssued, (nowMs - lastReport) / 1000.0);
+        lastIssued = issued;
+        lastReport = nowMs;
+    }
+    for (std::thread& t : threads) t.join();
+
+    // Bảng bên dưới (in khi thoát) là latency đã sửa coordinated omission; đây là số curl tự đo
+    log("🏁 Load finished: " + std::to_string(loadIssued.load()) + " requests scheduled");
+    log("📉 Service time (ms, chưa tính thời gian chờ theo lịch)");
+    for (int e = 0; e < ENDPOINT_COUNT; e++) {
+        const LatencyHistogram& h = serviceLatency[e];
+        char line[160];
+        std::snprintf(line, sizeof(line), "   %-10s %9llu %8.1f %8.1f %8.1f %8.1f %8.1f",
+                      endpointName(static_cast<Endpoint>(e)), static_cast<unsigned long long>(h.count()),
+                      h.percentileUs(0.5) / 1000.0, h.percentileUs(0.9) / 1000.0,
+                      h.percentileUs(0.99) / 1000.0, h.percentileUs(0.999) / 1000.0, h.maxUs() / 1000.0);
+        log(line);
     }
 }
 
 // ============================================================================
 // 🚀 MAIN FUNCTION
 // ============================================================================
-int main() {
+void printUsage(const char* prog) {
+    std::cout << "Usage: " << prog << " [--fleet N] [--first-slot ID] [--workers W] [--verbose]"
+              << " [--speed X|max] [--sim-start TIME] [--duration-hours H]"
+              << " [--seed N] [--trace FILE] [--replay FILE]"
+              << " [--load R] [--arrival A] [--ramp-from R0] [--load-seconds S] [--mix S:I:O]"
+              << " [--metrics-port P] [--log-level L]" << std::endl;
+    std::cout << "  --fleet N        Mô phỏng N slot trong một process (fleet mode)" << std::endl;
+    std::cout << "  --first-slot ID  Slot ID đầu tiên của fleet (mặc định " << SLOT_ID << ")" << std::endl;
+    std::cout << "  --workers W      Số worker thread (mặc định theo số core, tối đa "
+              << FLEET_MAX_WORKERS << ")" << std::endl;
+    std::cout << "  --verbose        Log từng phép đo trong fleet mode" << std::endl;
+    std::cout << "  --speed X|max    Tăng tốc thời gian ảo X lần, 'max' = chạy nhanh nhất có thể" << std::endl;
+    std::cout << "  --sim-start \"YYYY-MM-DD HH:MM\"  Thời điểm bắt đầu của đồng hồ ảo" << std::endl;
+    std::cout << "  --duration-hours H  Dừng sau H giờ mô phỏng (ví dụ 168 = một tuần)" << std::endl;
+    std::cout << "  --seed N         Seed cố định → cùng chuỗi khoảng cách cho mọi lần chạy" << std::endl;
+    std::cout << "  --trace FILE     Ghi trace nhị phân (phép đo + status update + HTTP status/latency)" << std::endl;
+    std::cout << "  --replay FILE    Phát lại các status update trong trace (kết hợp --speed)" << std::endl;
+    std::cout << "  --load R         Load generator open-loop: R request/s (status + checkin + checkout)" << std::endl;
+    std::cout << "  --arrival A      constant|poisson|ramp (mặc định constant)" << std::endl;
+    std::cout << "  --ramp-from R0   Với ramp: tăng tuyến tính từ R0 tới R req/s" << std::endl;
+    std::cout << "  --load-seconds S Thời gian chạy load (mặc định " << LOAD_DEFAULT_SECONDS << "s)" << std::endl;
+    std::cout << "  --mix S:I:O      Tỉ lệ status:checkin:checkout (mặc định 80:10:10)" << std::endl;
+    std::cout << "  --metrics-port P Mở endpoint Prometheus http://0.0.0.0:P/metrics" << std::endl;
+    std::cout << "  --log-level L    debug|info|warn|error (mặc định info)" << std::endl;
+}
+
+int64_t parseLocalTime(const std::string& text) {
+    struct tm timeinfo = {};
+    std::istringstream ss(text);
+    ss >> std::get_time(&timeinfo, "%Y-%m-%d %H:%M");
+    if (ss.fail()) return 0;
+    timeinfo.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&timeinfo)) * 1000;
+}
+
+int main(int argc, char** argv) {
+    SimOptions options;
+    bool verboseFleet = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--fleet" && i + 1 < argc) {
+            options.slots = std::atoi(argv[++i]);
+        } else if (arg == "--first-slot" && i + 1 < argc) {
+            options.firstSlotId = std::atoi(argv[++i]);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            options.workers = std::atoi(argv[++i]);
+        } else if (arg == "--verbose") {
+            verboseFleet = true;
+        } else if (arg == "--speed" && i + 1 < argc) {
+            std::string value = argv[++i];
+            options.speed = (value == "max") ? 0.0 : std::atof(value.c_str());
+        } else if (arg == "--sim-start" && i + 1 < argc) {
+            options.startEpochMs = parseLocalTime(argv[++i]);
+        } else if (arg == "--duration-hours" && i + 1 < argc) {
+            options.durationMs = static_cast<int64_t>(std::atof(argv[++i]) * 3600000.0);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.hasSeed = true;
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options.tracePath = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            options.replayPath = argv[++i];
+        } else if (arg == "--load" && i + 1 < argc) {
+            options.loadRate = std::atof(argv[++i]);
+        } else if (arg == "--arrival" && i + 1 < argc) {
+            if (!parseArrivalPattern(argv[++i], options.arrival)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--ramp-from" && i + 1 < argc) {
+            options.rampFrom = std::atof(argv[++i]);
+        } else if (arg == "--load-seconds" && i + 1 < argc) {
+            options.loadSeconds = std::atoi(argv[++i]);
+        } else if (arg == "--mix" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%d:%d:%d", &options.mix[ENDPOINT_STATUS], &options.mix[ENDPOINT_CHECKIN],
+                            &options.mix[ENDPOINT_CHECKOUT]) != 3 ||
+                options.mix[ENDPOINT_STATUS] < 0 || options.mix[ENDPOINT_CHECKIN] < 0 ||
+                options.mix[ENDPOINT_CHECKOUT] < 0 ||
+                options.mix[ENDPOINT_STATUS] + options.mix[ENDPOINT_CHECKIN] + options.mix[ENDPOINT_CHECKOUT] <= 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            options.metricsPort = std::atoi(argv[++i]);
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            logger.setLevel(parseLogLevel(argv[++i]));
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (options.slots > 0) verboseLog = verboseFleet;
+    if (options.loadRate > 0) {
+        // Arrival rate tính theo giây thật
+        options.speed = 1.0;
+        if (options.slots <= 0) options.slots = LOAD_DEFAULT_SLOTS;
+        verboseLog = false;
+    }
+
+    TraceReader replayReader;
+    if (!options.replayPath.empty()) {
+        std::string error;
+        if (!replayReader.open(options.replayPath, error)) {
+            log(LOG_ERROR, "❌ Replay: " + error);
+            return 1;
+        }
+        // Đồng hồ ảo bắt đầu đúng thời điểm của trace để giữ nhịp gốc
+        options.startEpochMs = replayReader.header().startEpochMs;
+        verboseLog = verboseFleet;
+    }
+    SimClock::configure(options.speed, options.startEpochMs);
+    logger.setShowWeekday(SimClock::speed() != 1.0);
+
+    simSeed = options.hasSeed ? options.seed : (static_cast<uint64_t>(rd()) << 32) ^ rd();
+    TraceWriter writer;
+    if (!options.tracePath.empty()) {
+        if (!writer.open(options.tracePath, simSeed, SimClock::epochMs())) {
+            log(LOG_ERROR, "❌ Không ghi được trace: " + options.tracePath);
+            return 1;
+        }
+        traceWriter = &writer;
+    }
+
     printHeader();
     
     // Connect to WiFi
     if (!connectWiFi()) {
-        log("❌ WiFi connection failed!");
+        log(LOG_ERROR, "❌ WiFi connection failed!");
         return 1;
     }
+
+#ifndef _WIN32
+    HttpTransport::globalInit();
+#endif
+    if (!loginAndGetToken()) {
+        log(LOG_WARN, "⚠️ Không có token - request sẽ bị 401 nếu backend bật auth");
+    }
     
     log("✅ Setup complete!");
     log("📊 Simulation Status:");
@@ -345,17 +1116,46 @@ int main() {
     log("   Pattern: " + std::string(AUTO_MODE ? "AUTO" : "MANUAL"));
     log("   Slot ID: " + std::to_string(SLOT_ID));
     log("   Threshold: " + std::to_string(DISTANCE_THRESHOLD) + " cm");
+    log("   Seed: " + std::to_string(simSeed));
+    if (traceWriter) log("   Trace: " + options.tracePath);
+    if (SimClock::speed() != 1.0) {
+        std::ostringstream clock;
+        if (SimClock::fastForward()) clock << "fast-forward";
+        else clock << "x" << SimClock::speed();
+        log("   Clock: " + clock.str());
+    }
+    MetricsServer metricsServer;
+    if (options.metricsPort > 0) {
+        if (metricsServer.start(options.metricsPort, renderMetrics)) {
+            log("   Metrics: http://0.0.0.0:" + std::to_string(options.metricsPort) + "/metrics");
+        } else {
+            log(LOG_WARN, "⚠️ Không mở được metrics port " + std::to_string(options.metricsPort));
+        }
+    }
     log("==================================================");
     
+    // Báo cáo latency khi thoát (hết --duration-hours, quit hoặc lỗi), trước khi logger dừng
+    std::atexit(printLatencyReport);
+    
     // Start command handler in separate thread
     std::thread commandThread(handleCommands);
     commandThread.detach();
     
     // Start main simulation loop
     try {
-        mainLoop();
+        if (!options.replayPath.empty()) {
+            log("🎞️ Replay " + options.replayPath + " (" + std::to_string(replayReader.recordCount()) +
+                " records, seed " + std::to_string(replayReader.header().seed) + ")");
+            runReplay(replayReader);
+        } else if (options.loadRate > 0) {
+            runLoad(options);
+        } else if (options.slots > 0) {
+            runFleet(options);
+        } else {
+            mainLoop(options);
+        }
     } catch (const std::exception& e) {
-        log("❌ Error: " + std::string(e.what()));
+        log(LOG_ERROR, "❌ Error: " + std::string(e.what()));
         return 1;
     }
     
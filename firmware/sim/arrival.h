@@ -0,0 +1,66 @@
+/*
+🚦 Arrival schedule cho load generator (open-loop)
+- Thời điểm gửi dự kiến (µs kể từ lúc bắt đầu) được tính trước, không phụ thuộc
+  response → backend chậm không làm giảm tải (tránh coordinated omission)
+- constant: cách đều 1/rate; poisson: khoảng cách theo phân phối mũ;
+  ramp: rate tăng tuyến tính từ rampFrom tới rate trong suốt thời gian chạy
+*/
+#ifndef SIM_ARRIVAL_H
+#define SIM_ARRIVAL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+
+enum ArrivalPattern : uint8_t {
+    ARRIVAL_CONSTANT = 0,
+    ARRIVAL_POISSON = 1,
+    ARRIVAL_RAMP = 2,
+};
+
+const double ARRIVAL_MIN_RATE = 0.1;  // req/s, tránh khoảng cách vô hạn khi ramp bắt đầu từ 0
+
+inline bool parseArrivalPattern(const std::string& name, ArrivalPattern& pattern) {
+    if (name == "constant") pattern = ARRIVAL_CONSTANT;
+    else if (name == "poisson") pattern = ARRIVAL_POISSON;
+    else if (name == "ramp") pattern = ARRIVAL_RAMP;
+    else return false;
+    return true;
+}
+
+class ArrivalSchedule {
+public:
+    ArrivalSchedule(ArrivalPattern pattern, double rate, double rampFrom, int64_t durationUs)
+        : pattern_(pattern), rate_(rate), rampFrom_(rampFrom), durationUs_(static_cast<double>(durationUs)) {}
+
+    // Rate tức thời (req/s) tại thời điểm elapsedUs
+    double rateAt(double elapsedUs) const {
+        double rate = rate_;
+        if (pattern_ == ARRIVAL_RAMP && durationUs_ > 0) {
+            double progress = std::min(1.0, elapsedUs / durationUs_);
+            rate = rampFrom_ + (rate_ - rampFrom_) * progress;
+        }
+        return std::max(rate, ARRIVAL_MIN_RATE);
+    }
+
+    // Thời điểm dự kiến của request kế tiếp sau request tại elapsedUs
+    // (giữ phần lẻ µs để rate cao không bị trôi do làm tròn)
+    template <typename Rng>
+    double next(double elapsedUs, Rng& rng) const {
+        double meanGapUs = 1e6 / rateAt(elapsedUs);
+        if (pattern_ == ARRIVAL_POISSON) {
+            std::exponential_distribution<double> gap(1.0 / meanGapUs);
+            return elapsedUs + gap(rng);
+        }
+        return elapsedUs + meanGapUs;
+    }
+
+private:
+    ArrivalPattern pattern_;
+    double rate_;
+    double rampFrom_;
+    double durationUs_;
+};
+
+#endif
@@ -0,0 +1,239 @@
+/*
+📝 Async logger cho ESP32 Simulator
+- Hot path chỉ ghi một LogRecord cố định 256 byte vào ring buffer MPSC lock-free
+  (Vyukov bounded queue) — không cấp phát, không format thời gian, không flush
+- Một writer thread nền format prefix "[HH:MM:SS.mmm] " (cache theo từng giây),
+  gom nhiều dòng rồi mới fwrite/fflush
+- Record có thể mang formatter + tham số thô (slot, distance...) để việc format
+  cũng được đẩy sang writer thread
+- Ring đầy → bỏ dòng và đếm, writer báo lại số dòng bị bỏ
+*/
+#ifndef SIM_ASYNC_LOG_H
+#define SIM_ASYNC_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+enum LogLevel : uint8_t {
+    LOG_DEBUG = 0,
+    LOG_INFO = 1,
+    LOG_WARN = 2,
+    LOG_ERROR = 3,
+};
+
+const size_t LOG_RING_CAPACITY = 8192;    // phải là lũy thừa của 2
+const size_t LOG_TEXT_CAPACITY = 216;
+const size_t LOG_LINE_CAPACITY = 512;
+const size_t LOG_WRITE_BUFFER = 64 * 1024;
+const int LOG_IDLE_SLEEP_MAX_MS = 20;
+
+struct LogRecord {
+    // Formatter chạy trên writer thread; nullptr → in nguyên text
+    using Formatter = size_t (*)(const LogRecord& record, char* out, size_t capacity);
+
+    int64_t epochMs;
+    Formatter format;
+    int32_t i0;
+    int32_t i1;
+    float f0;
+    uint8_t b0;
+    uint8_t level;
+    uint16_t length;
+    char text[LOG_TEXT_CAPACITY];
+};
+
+static_assert(sizeof(LogRecord) <= 256, "LogRecord phải gọn trong 256 byte");
+
+class AsyncLogger {
+public:
+    AsyncLogger() {
+        for (size_t i = 0; i < LOG_RING_CAPACITY; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        writer_ = std::thread([this] { writerLoop(); });
+    }
+
+    ~AsyncLogger() {
+        stop_.store(true, std::memory_order_release);
+        if (writer_.joinable()) writer_.join();
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    void setLevel(LogLevel level) { minLevel_.store(level, std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const { return level >= minLevel_.load(std::memory_order_relaxed); }
+
+    // true → prefix kèm thứ trong tuần (dùng khi đồng hồ ảo chạy nhanh)
+    void setShowWeekday(bool show) { showWeekday_ = show; }
+
+    // fill(LogRecord&) điền nội dung trực tiếp vào ô của ring, chạy trên thread gọi
+    template <typename Fill>
+    void push(LogLevel level, int64_t epochMs, Fill fill) {
+        if (!enabled(level)) return;
+
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & (LOG_RING_CAPACITY - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        LogRecord& record = cell->record;
+        record.epochMs = epochMs;
+        record.format = nullptr;
+        record.level = level;
+        record.length = 0;
+        fill(record);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    void pushText(LogLevel level, int64_t epochMs, const char* text, size_t length) {
+        push(level, epochMs, [&](LogRecord& record) {
+            size_t n = length < LOG_TEXT_CAPACITY ? length : LOG_TEXT_CAPACITY;
+            std::memcpy(record.text, text, n);
+            record.length = static_cast<uint16_t>(n);
+        });
+    }
+
+    // Chờ writer in hết các dòng đã push (trước khi in trực tiếp ra stdout)
+    void flush() {
+        size_t target = enqueuePos_.load(std::memory_order_acquire);
+        while (dequeuePos_.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::fflush(stdout);
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    Cell cells_[LOG_RING_CAPACITY];
+    alignas(64) std::atomic<size_t> enqueuePos_{0};
+    alignas(64) std::atomic<size_t> dequeuePos_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint8_t> minLevel_{LOG_INFO};
+    std::atomic<bool> stop_{false};
+    bool showWeekday_ = false;
+    std::thread writer_;
+
+    // Cache prefix theo giây: strftime/localtime chỉ chạy khi sang giây mới
+    int64_t cachedSecond_ = -1;
+    char cachedPrefix_[32];
+    size_t cachedPrefixLength_ = 0;
+
+    char buffer_[LOG_WRITE_BUFFER];
+    size_t buffered_ = 0;
+
+    bool popOne() {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos & (LOG_RING_CAPACITY - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+
+        writeRecord(cell.record);
+        cell.sequence.store(pos + LOG_RING_CAPACITY, std::memory_order_release);
+        dequeuePos_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    void writerLoop() {
+        int idleMs = 1;
+        uint64_t reportedDrops = 0;
+        while (true) {
+            bool any = false;
+            while (popOne()) any = true;
+
+            uint64_t drops = dropped();
+            if (drops != reportedDrops) {
+                char line[96];
+                int n = std::snprintf(line, sizeof(line), "⚠️ Logger: %llu dòng log bị bỏ (ring đầy)\n",
+                                      static_cast<unsigned long long>(drops - reportedDrops));
+                append(line, static_cast<size_t>(n));
+                reportedDrops = drops;
+                any = true;
+            }
+
+            if (any) {
+                flushBuffer();
+                idleMs = 1;
+                continue;
+            }
+            if (stop_.load(std::memory_order_acquire)) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(idleMs));
+            if (idleMs < LOG_IDLE_SLEEP_MAX_MS) idleMs *= 2;
+        }
+        flushBuffer();
+    }
+
+    void writeRecord(const LogRecord& record) {
+        char line[LOG_LINE_CAPACITY];
+        size_t n = formatPrefix(record.epochMs, line);
+        if (record.format) {
+            n += record.format(record, line + n, sizeof(line) - n - 1);
+        } else {
+            std::memcpy(line + n, record.text, record.length);
+            n += record.length;
+        }
+        line[n++] = '\n';
+        append(line, n);
+    }
+
+    size_t formatPrefix(int64_t epochMs, char* out) {
+        int64_t second = epochMs / 1000;
+        if (second != cachedSecond_) {
+            std::time_t t = static_cast<std::time_t>(second);
+            struct tm timeinfo;
+#ifdef _WIN32
+            localtime_s(&timeinfo, &t);
+#else
+            localtime_r(&t, &timeinfo);
+#endif
+            cachedPrefixLength_ = std::strftime(cachedPrefix_, sizeof(cachedPrefix_),
+                                                showWeekday_ ? "[%a %H:%M:%S." : "[%H:%M:%S.", &timeinfo);
+            cachedSecond_ = second;
+        }
+        std::memcpy(out, cachedPrefix_, cachedPrefixLength_);
+        int ms = static_cast<int>(epochMs % 1000);
+        char* p = out + cachedPrefixLength_;
+        p[0] = static_cast<char>('0' + ms / 100);
+        p[1] = static_cast<char>('0' + (ms / 10) % 10);
+        p[2] = static_cast<char>('0' + ms % 10);
+        p[3] = ']';
+        p[4] = ' ';
+        return cachedPrefixLength_ + 5;
+    }
+
+    void append(const char* data, size_t length) {
+        if (buffered_ + length > sizeof(buffer_)) flushBuffer();
+        std::memcpy(buffer_ + buffered_, data, length);
+        buffered_ += length;
+    }
+
+    void flushBuffer() {
+        if (buffered_ == 0) return;
+        std::fwrite(buffer_, 1, buffered_, stdout);
+        std::fflush(stdout);
+        buffered_ = 0;
+    }
+};
+
+#endif
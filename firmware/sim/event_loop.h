@@ -0,0 +1,228 @@
+/*
+⏱️ Event loop cho ESP32 Simulator
+- Min-heap deadline (ms) → mỗi slot được đo đúng lúc đến hạn, không poll
+- Linux: timerfd + epoll, socket của curl multi được multiplex trên cùng vòng lặp
+- Nền tảng khác: ngủ tới deadline gần nhất, HTTP gọi đồng bộ
+- Deadline tính theo SimClock (thời gian ảo); fast-forward thì không chờ timer
+*/
+#ifndef SIM_EVENT_LOOP_H
+#define SIM_EVENT_LOOP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "http_transport.h"
+#include "sim_clock.h"
+
+#ifdef __linux__
+#define SIM_HAS_EPOLL 1
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+const int EVENT_LOOP_MAX_EVENTS = 64;
+const size_t EVENT_LOOP_FAST_BATCH = 1024;       // số timer tối đa mỗi vòng ở fast-forward
+const size_t EVENT_LOOP_MAX_IN_FLIGHT = 256;     // fast-forward chờ bớt request trước khi chạy tiếp
+
+class EventLoop {
+public:
+    using TimerHandler = std::function<void(uint32_t id, int64_t nowMs)>;
+
+    explicit EventLoop(TimerHandler onTimer) : onTimer_(std::move(onTimer)) {
+#ifdef SIM_HAS_EPOLL
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = timerFd_;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, timerFd_, &ev);
+
+        CURLM* multi = transport_.multi();
+        curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, onCurlSocket);
+        curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, onCurlTimer);
+        curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+#endif
+    }
+
+    ~EventLoop() {
+#ifdef SIM_HAS_EPOLL
+        close(timerFd_);
+        close(epollFd_);
+#endif
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Fast-forward: khi còn request đang chờ, thời gian ảo chỉ được chạy tối đa windowMs
+    // kể từ lúc request đầu tiên được gửi (để response luôn về trước phép đo kế tiếp của slot)
+    void setFastForwardWindow(int64_t windowMs) { fastWindowMs_ = windowMs; }
+
+    void schedule(int64_t deadlineMs, uint32_t id) {
+        timers_.push(Timer(deadlineMs, id));
+    }
+
+#ifdef SIM_HAS_EPOLL
+    HttpTransport& transport() { return transport_; }
+#endif
+
+    // Chạy tới khi mọi timer đã qua untilMs (ảo) và không còn request; untilMs < 0 → mãi mãi
+    void run(int64_t untilMs = -1) {
+        if (SimClock::fastForward()) SimClock::beginThread();
+
+        while (true) {
+            bool timersLeft = !timers_.empty() && (untilMs < 0 || timers_.top().first <= untilMs);
+            if (!timersLeft && inFlight() == 0) return;
+#ifdef SIM_HAS_EPOLL
+            int waitMs = -1;
+            if (SimClock::fastForward()) {
+                // Còn timer được phép chạy → chỉ poll socket, không chờ
+                if (timersLeft && canFastForward()) waitMs = 0;
+                else if (curlDeadlineMs_ >= 0) waitMs = static_cast<int>(std::max<int64_t>(curlDeadlineMs_ - SimClock::realMs(), 0));
+            } else {
+                armTimer(timersLeft);
+            }
+
+            epoll_event events[EVENT_LOOP_MAX_EVENTS];
+            int n = epoll_wait(epollFd_, events, EVENT_LOOP_MAX_EVENTS, waitMs);
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == timerFd_) {
+                    uint64_t expirations;
+                    ssize_t unused = read(timerFd_, &expirations, sizeof(expirations));
+                    (void)unused;
+                    continue;
+                }
+                int mask = 0;
+                if (events[i].events & EPOLLIN) mask |= CURL_CSELECT_IN;
+                if (events[i].events & EPOLLOUT) mask |= CURL_CSELECT_OUT;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) mask |= CURL_CSELECT_ERR;
+                transport_.socketAction(fd, mask);
+            }
+
+            if (curlDeadlineMs_ >= 0 && SimClock::realMs() >= curlDeadlineMs_) {
+                curlDeadlineMs_ = -1;
+                transport_.socketAction(CURL_SOCKET_TIMEOUT, 0);
+            }
+#else
+            if (!SimClock::fastForward() && timersLeft) {
+                int64_t wait = SimClock::toRealNs(timers_.top().first) / 1000000 - SimClock::realMs();
+                if (wait > 0) std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+            }
+#endif
+            if (SimClock::fastForward()) fastForward(untilMs);
+            else fireDue(SimClock::nowMs(), untilMs);
+        }
+    }
+
+    size_t inFlight() const {
+#ifdef SIM_HAS_EPOLL
+        return transport_.inFlight();
+#else
+        return 0;
+#endif
+    }
+
+private:
+    using Timer = std::pair<int64_t, uint32_t>;  // (deadline ms, id)
+
+    TimerHandler onTimer_;
+    int64_t fastWindowMs_ = 1000;
+    int64_t holdMs_ = -1;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+
+    void fireDue(int64_t now, int64_t untilMs) {
+        while (!timers_.empty() && timers_.top().first <= now &&
+               (untilMs < 0 || timers_.top().first <= untilMs)) {
+            uint32_t id = timers_.top().second;
+            timers_.pop();
+            onTimer_(id, now);
+        }
+    }
+
+    bool canFastForward() {
+        size_t pending = inFlight();
+        if (pending == 0) {
+            holdMs_ = -1;
+            return true;
+        }
+        if (pending >= EVENT_LOOP_MAX_IN_FLIGHT) return false;
+        if (holdMs_ < 0) holdMs_ = SimClock::nowMs();
+        return timers_.empty() || timers_.top().first < holdMs_ + fastWindowMs_;
+    }
+
+    // Thời gian ảo nhảy tới từng deadline theo thứ tự
+    void fastForward(int64_t untilMs) {
+        for (size_t fired = 0; fired < EVENT_LOOP_FAST_BATCH && !timers_.empty(); fired++) {
+            if (!canFastForward()) break;
+            Timer timer = timers_.top();
+            if (untilMs >= 0 && timer.first > untilMs) break;
+            timers_.pop();
+            if (timer.first > SimClock::nowMs()) SimClock::advanceTo(timer.first);
+            onTimer_(timer.second, SimClock::nowMs());
+        }
+    }
+
+#ifdef SIM_HAS_EPOLL
+    int epollFd_ = -1;
+    int timerFd_ = -1;
+    int64_t curlDeadlineMs_ = -1;
+    HttpTransport transport_;
+
+    // timerfd luôn được đặt vào deadline sớm nhất (slot hoặc timeout của curl), theo ns thật
+    void armTimer(bool timersLeft) {
+        int64_t next = -1;
+        if (timersLeft) next = SimClock::toRealNs(timers_.top().first);
+        if (curlDeadlineMs_ >= 0) {
+            int64_t curlNs = curlDeadlineMs_ * 1000000;
+            if (next < 0 || curlNs < next) next = curlNs;
+        }
+
+        itimerspec spec{};
+        if (next >= 0) {
+            // Absolute CLOCK_MONOTONIC; deadline đã qua vẫn fire ngay (giá trị 0 sẽ disarm)
+            int64_t ns = std::max<int64_t>(next, 1);
+            spec.it_value.tv_sec = ns / 1000000000;
+            spec.it_value.tv_nsec = ns % 1000000000;
+        }
+        timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    static int onCurlSocket(CURL*, curl_socket_t fd, int what, void* userp, void* socketp) {
+        EventLoop* loop = static_cast<EventLoop*>(userp);
+        if (what == CURL_POLL_REMOVE) {
+            epoll_ctl(loop->epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+            curl_multi_assign(loop->transport_.multi(), fd, nullptr);
+            return 0;
+        }
+
+        epoll_event ev{};
+        ev.data.fd = fd;
+        if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+        if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+        if (socketp) {
+            epoll_ctl(loop->epollFd_, EPOLL_CTL_MOD, fd, &ev);
+        } else {
+            epoll_ctl(loop->epollFd_, EPOLL_CTL_ADD, fd, &ev);
+            curl_multi_assign(loop->transport_.multi(), fd, loop);
+        }
+        return 0;
+    }
+
+    static int onCurlTimer(CURLM*, long timeoutMs, void* userp) {
+        EventLoop* loop = static_cast<EventLoop*>(userp);
+        loop->curlDeadlineMs_ = (timeoutMs < 0) ? -1 : SimClock::realMs() + timeoutMs;
+        return 0;
+    }
+#endif
+};
+
+#endif
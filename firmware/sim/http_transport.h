@@ -0,0 +1,316 @@
+/*
+🌐 HTTP transport cho ESP32 Simulator
+- Một curl multi handle cho mỗi thread → connection cache keep-alive riêng, không cần lock
+- DNS cache + TLS session chia sẻ giữa các thread qua CURLSH
+- Easy handle được tái sử dụng theo host (scheme://host:port)
+- request(): gọi đồng bộ; submit(): bất đồng bộ, multi handle được EventLoop điều khiển
+*/
+#ifndef SIM_HTTP_TRANSPORT_H
+#define SIM_HTTP_TRANSPORT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+struct HttpResult {
+    bool ok = false;          // 2xx
+    long status = 0;          // HTTP status, 0 nếu lỗi transport
+    double latencyMs = 0.0;
+    std::string error;
+};
+
+using HttpCallback = std::function<void(const HttpResult&)>;
+
+#ifndef _WIN32
+#include <curl/curl.h>
+
+const long HTTP_TIMEOUT_MS = 10000;
+const long HTTP_CONNECT_TIMEOUT_MS = 3000;
+const long HTTP_DNS_CACHE_SECONDS = 300;
+const long HTTP_MAX_HOST_CONNECTIONS = 16;
+const size_t HTTP_MAX_RESPONSE_LOG = 256;
+
+class HttpTransport {
+public:
+    HttpTransport() {
+        multi_ = curl_multi_init();
+        curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, HTTP_MAX_HOST_CONNECTIONS);
+    }
+
+    ~HttpTransport() {
+        // Request bất đồng bộ chưa xong: gỡ khỏi multi, bỏ callback
+        for (HttpCall* call : inFlight_) {
+            curl_multi_remove_handle(multi_, call->easy);
+            unrefHeaders(call);
+            curl_easy_cleanup(call->easy);
+            delete call;
+        }
+        for (HostPool& pool : idle_) {
+            for (HttpCall* call : pool.idle) {
+                curl_easy_cleanup(call->easy);
+                delete call;
+            }
+        }
+        curl_multi_cleanup(multi_);
+        for (HeaderList* list : headerLists_) {
+            curl_slist_free_all(list->slist);
+            delete list;
+        }
+    }
+
+    HttpTransport(const HttpTransport&) = delete;
+    HttpTransport& operator=(const HttpTransport&) = delete;
+
+    // Gọi một lần trước khi tạo worker thread
+    static void globalInit() {
+        curl_global_init(CURL_GLOBAL_ALL);
+        CURLSH* share = shareHandle();
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShared);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShared);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+
+    static void setAuthToken(const std::string& token) { authToken() = token; }
+
+    HttpResult request(const char* method, const std::string& url, std::string_view body) {
+        HttpCall* call = prepare(method, url, body);
+
+        curl_multi_add_handle(multi_, call->easy);
+        CURLcode code = CURLE_OK;
+        int running = 1;
+        while (running) {
+            if (curl_multi_perform(multi_, &running) != CURLM_OK) break;
+            if (running) curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+        }
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi_, &queued)) {
+            if (msg->msg == CURLMSG_DONE && msg->easy_handle == call->easy) code = msg->data.result;
+        }
+        curl_multi_remove_handle(multi_, call->easy);
+
+        HttpResult result = finish(call, code);
+        lastResponse_.swap(call->response);
+        release(call);
+        return result;
+    }
+
+    // Request bất đồng bộ: chỉ dùng khi multi handle đã gắn vào EventLoop
+    void submit(const char* method, const std::string& url, std::string_view body, HttpCallback done) {
+        HttpCall* call = prepare(method, url, body);
+        call->done = std::move(done);
+        curl_multi_add_handle(multi_, call->easy);
+        inFlight_.push_back(call);
+    }
+
+    // EventLoop gọi khi socket sẵn sàng hoặc timer của curl hết hạn
+    void socketAction(curl_socket_t fd, int mask) {
+        int running = 0;
+        curl_multi_socket_action(multi_, fd, mask, &running);
+
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi_, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            HttpCall* call = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &call);
+            CURLcode code = msg->data.result;
+            curl_multi_remove_handle(multi_, call->easy);
+            for (HttpCall*& slot : inFlight_) {
+                if (slot != call) continue;
+                slot = inFlight_.back();
+                inFlight_.pop_back();
+                break;
+            }
+
+            HttpResult result = finish(call, code);
+            HttpCallback done = std::move(call->done);
+            release(call);
+            if (done) done(result);
+        }
+    }
+
+    CURLM* multi() const { return multi_; }
+    size_t inFlight() const { return inFlight_.size(); }
+
+    // Body của response gần nhất (ví dụ để đọc token sau login)
+    const std::string& lastResponse() const { return lastResponse_; }
+
+private:
+    // Header list theo token. Easy handle đang chạy giữ con trỏ qua CURLOPT_HTTPHEADER →
+    // token đổi thì list cũ chỉ được giải phóng khi không còn request nào dùng (refs == 0)
+    struct HeaderList {
+        struct curl_slist* slist = nullptr;
+        std::string token;
+        size_t refs = 0;
+    };
+
+    // Easy handle + buffer đi kèm, tái sử dụng nguyên cặp nên không cấp phát lại mỗi request
+    struct HttpCall {
+        CURL* easy = nullptr;
+        HeaderList* headers = nullptr;   // list đang gắn vào easy trong lúc request chạy
+        std::string host;
+        std::string body;
+        std::string response;
+        HttpCallback done;
+    };
+
+    // Simulator chỉ nói chuyện với vài host → tìm tuyến tính, không cấp phát key mỗi request
+    struct HostPool {
+        std::string host;
+        std::vector<HttpCall*> idle;
+    };
+
+    CURLM* multi_ = nullptr;
+    std::vector<HostPool> idle_;
+    std::vector<HeaderList*> headerLists_;   // phần tử cuối = list của token hiện tại
+    std::vector<HttpCall*> inFlight_;         // request submit() chưa xong
+    std::string lastResponse_;
+
+    static CURLSH* shareHandle() {
+        static CURLSH* share = curl_share_init();
+        return share;
+    }
+
+    static std::string& authToken() {
+        static std::string token;
+        return token;
+    }
+
+    static std::mutex& shareMutex(curl_lock_data data) {
+        static std::mutex mutexes[CURL_LOCK_DATA_LAST];
+        return mutexes[data];
+    }
+
+    static void lockShared(CURL*, curl_lock_data data, curl_lock_access, void*) {
+        shareMutex(data).lock();
+    }
+
+    static void unlockShared(CURL*, curl_lock_data data, void*) {
+        shareMutex(data).unlock();
+    }
+
+    static size_t onWrite(char* ptr, size_t size, size_t nmemb, void* userdata) {
+        static_cast<std::string*>(userdata)->append(ptr, size * nmemb);
+        return size * nmemb;
+    }
+
+    static std::string_view hostKey(std::string_view url) {
+        size_t schemeEnd = url.find("://");
+        size_t hostStart = (schemeEnd == std::string_view::npos) ? 0 : schemeEnd + 3;
+        size_t hostEnd = url.find('/', hostStart);
+        return url.substr(0, hostEnd);
+    }
+
+    HostPool& poolFor(std::string_view host) {
+        for (HostPool& pool : idle_) {
+            if (pool.host == host) return pool;
+        }
+        idle_.push_back(HostPool{std::string(host), {}});
+        return idle_.back();
+    }
+
+    // Header list chỉ build lại khi token đổi; list cũ không còn ai dùng thì giải phóng luôn
+    HeaderList* headers() {
+        const std::string& token = authToken();
+        if (!headerLists_.empty() && headerLists_.back()->token == token) return headerLists_.back();
+        if (!headerLists_.empty() && headerLists_.back()->refs == 0) {
+            curl_slist_free_all(headerLists_.back()->slist);
+            delete headerLists_.back();
+            headerLists_.pop_back();
+        }
+        HeaderList* list = new HeaderList();
+        list->slist = curl_slist_append(nullptr, "Content-Type: application/json");
+        list->slist = curl_slist_append(list->slist, "Accept: application/json");
+        if (!token.empty()) {
+            list->slist = curl_slist_append(list->slist, ("Authorization: Bearer " + token).c_str());
+        }
+        list->token = token;
+        headerLists_.push_back(list);
+        return list;
+    }
+
+    // Request xong (hoặc bị huỷ): thả list; list cũ (không phải của token hiện tại) hết người dùng → free
+    void unrefHeaders(HttpCall* call) {
+        HeaderList* list = call->headers;
+        call->headers = nullptr;
+        if (!list || --list->refs > 0 || list == headerLists_.back()) return;
+        for (size_t i = 0; i < headerLists_.size(); i++) {
+            if (headerLists_[i] != list) continue;
+            headerLists_.erase(headerLists_.begin() + i);
+            break;
+        }
+        curl_slist_free_all(list->slist);
+        delete list;
+    }
+
+    HttpCall* acquire(std::string_view host) {
+        std::vector<HttpCall*>& pool = poolFor(host).idle;
+        if (!pool.empty()) {
+            HttpCall* call = pool.back();
+            pool.pop_back();
+            return call;
+        }
+
+        HttpCall* call = new HttpCall();
+        call->host.assign(host);
+        call->easy = curl_easy_init();
+        CURL* easy = call->easy;
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, call);
+        curl_easy_setopt(easy, CURLOPT_SHARE, shareHandle());
+        curl_easy_setopt(easy, CURLOPT_USERAGENT, "ESP32-Simulator/1.0");
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, HTTP_TIMEOUT_MS);
+        curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, HTTP_CONNECT_TIMEOUT_MS);
+        curl_easy_setopt(easy, CURLOPT_DNS_CACHE_TIMEOUT, HTTP_DNS_CACHE_SECONDS);
+        curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, onWrite);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, &call->response);
+        return call;
+    }
+
+    void release(HttpCall* call) {
+        unrefHeaders(call);
+        poolFor(call->host).idle.push_back(call);
+    }
+
+    HttpCall* prepare(const char* method, const std::string& url, std::string_view body) {
+        HttpCall* call = acquire(hostKey(url));
+        CURL* easy = call->easy;
+
+        call->body.assign(body.data(), body.size());
+        call->response.clear();
+        curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+        if (call->body.empty()) {
+            curl_easy_setopt(easy, CURLOPT_HTTPGET, 1L);
+        } else {
+            curl_easy_setopt(easy, CURLOPT_POSTFIELDS, call->body.c_str());
+            curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(call->body.size()));
+        }
+        curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, method);
+        call->headers = headers();
+        call->headers->refs++;
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, call->headers->slist);
+        return call;
+    }
+
+    HttpResult finish(HttpCall* call, CURLcode code) {
+        HttpResult result;
+        curl_off_t totalUs = 0;
+        curl_easy_getinfo(call->easy, CURLINFO_TOTAL_TIME_T, &totalUs);
+        result.latencyMs = totalUs / 1000.0;
+
+        if (code != CURLE_OK) {
+            result.error = curl_easy_strerror(code);
+        } else {
+            curl_easy_getinfo(call->easy, CURLINFO_RESPONSE_CODE, &result.status);
+            result.ok = (result.status >= 200 && result.status < 300);
+            if (!result.ok) result.error = call->response.substr(0, HTTP_MAX_RESPONSE_LOG);
+        }
+        return result;
+    }
+};
+#endif
+
+#endif
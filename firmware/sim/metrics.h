@@ -0,0 +1,194 @@
+/*
+📈 Metrics cho ESP32 Simulator
+- LatencyHistogram: histogram kiểu HDR (log-linear, 64 sub-bucket mỗi bậc lũy thừa 2
+  → sai số tương đối < 1.6%), ghi bằng atomic nên mọi worker ghi chung được
+- EndpointStats: latency + sent/failed/retried cho từng endpoint (status, checkin, checkout)
+- MetricsServer: HTTP server tối giản trả text format của Prometheus tại /metrics
+*/
+#ifndef SIM_METRICS_H
+#define SIM_METRICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+const int HISTOGRAM_SUB_BUCKET_BITS = 6;
+const uint64_t HISTOGRAM_SUB_BUCKETS = 1ULL << HISTOGRAM_SUB_BUCKET_BITS;
+const size_t HISTOGRAM_BUCKETS = 32 * HISTOGRAM_SUB_BUCKETS;  // tới ~2^37 µs, dư cho timeout 10s
+const double HISTOGRAM_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+const int METRICS_CLIENT_TIMEOUT_MS = 2000;  // client không gửi/đọc gì → đóng, không giữ thread server
+
+enum Endpoint : uint8_t {
+    ENDPOINT_STATUS = 0,
+    ENDPOINT_CHECKIN = 1,
+    ENDPOINT_CHECKOUT = 2,
+    ENDPOINT_COUNT = 3,
+};
+
+inline const char* endpointName(Endpoint endpoint) {
+    switch (endpoint) {
+        case ENDPOINT_STATUS: return "status";
+        case ENDPOINT_CHECKIN: return "checkin";
+        case ENDPOINT_CHECKOUT: return "checkout";
+        default: return "unknown";
+    }
+}
+
+// Giá trị tính bằng µs
+class LatencyHistogram {
+public:
+    void record(uint64_t valueUs) {
+        counts_[indexOf(valueUs)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sumUs_.fetch_add(valueUs, std::memory_order_relaxed);
+        uint64_t seen = maxUs_.load(std::memory_order_relaxed);
+        while (seen < valueUs && !maxUs_.compare_exchange_weak(seen, valueUs, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sumUs() const { return sumUs_.load(std::memory_order_relaxed); }
+    uint64_t maxUs() const { return maxUs_.load(std::memory_order_relaxed); }
+
+    // Giá trị tại quantile q (0..1): cận trên của bucket chứa mẫu thứ ceil(q × count)
+    uint64_t percentileUs(double q) const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) total += counts_[i].load(std::memory_order_relaxed);
+        if (total == 0) return 0;
+
+        uint64_t target = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+        if (target == 0) target = 1;
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            cumulative += counts_[i].load(std::memory_order_relaxed);
+            if (cumulative >= target) return std::min(valueAt(i), maxUs());
+        }
+        return maxUs();
+    }
+
+private:
+    std::atomic<uint64_t> counts_[HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sumUs_{0};
+    std::atomic<uint64_t> maxUs_{0};
+
+    // [0, 128) giữ nguyên giá trị; sau đó mỗi bậc [2^k, 2^(k+1)) chia thành 64 bucket bằng nhau
+    static size_t indexOf(uint64_t value) {
+        if (value < 2 * HISTOGRAM_SUB_BUCKETS) return static_cast<size_t>(value);
+        int shift = 1;
+        while ((value >> shift) >= 2 * HISTOGRAM_SUB_BUCKETS) shift++;
+        size_t index = (shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+        return std::min(index, HISTOGRAM_BUCKETS - 1);
+    }
+
+    static uint64_t valueAt(size_t index) {
+        if (index < 2 * HISTOGRAM_SUB_BUCKETS) return index;
+        int shift = static_cast<int>(index / HISTOGRAM_SUB_BUCKETS) - 1;
+        uint64_t base = (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+        return base + ((1ULL << shift) - 1);
+    }
+};
+
+struct EndpointStats {
+    LatencyHistogram latency;
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> retried{0};
+};
+
+// Summary của Prometheus: quantile + _sum + _count (đơn vị giây)
+inline void appendPrometheusSummary(std::string& out, const char* name, const char* endpoint,
+                                    const LatencyHistogram& histogram) {
+    char line[192];
+    for (double q : HISTOGRAM_QUANTILES) {
+        std::snprintf(line, sizeof(line), "%s{endpoint=\"%s\",quantile=\"%g\"} %.6f\n", name, endpoint, q,
+                      histogram.percentileUs(q) / 1e6);
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "%s_sum{endpoint=\"%s\"} %.6f\n%s_count{endpoint=\"%s\"} %llu\n",
+                  name, endpoint, histogram.sumUs() / 1e6, name, endpoint,
+                  static_cast<unsigned long long>(histogram.count()));
+    out += line;
+}
+
+// Một thread accept tuần tự: Prometheus scrape vài giây một lần nên không cần gì hơn
+class MetricsServer {
+public:
+    using Renderer = std::function<std::string()>;
+
+    bool start(int port, Renderer render) {
+#ifdef _WIN32
+        (void)port;
+        (void)render;
+        return false;
+#else
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        std::thread([fd, render] { serve(fd, render); }).detach();
+        return true;
+#endif
+    }
+
+private:
+#ifndef _WIN32
+    static void serve(int listenFd, const Renderer& render) {
+        while (true) {
+            int client = accept(listenFd, nullptr, nullptr);
+            if (client < 0) continue;
+
+            // Một thread phục vụ tuần tự → timeout recv/send để client treo không chặn các lần scrape sau
+            timeval timeout{};
+            timeout.tv_sec = METRICS_CLIENT_TIMEOUT_MS / 1000;
+            timeout.tv_usec = (METRICS_CLIENT_TIMEOUT_MS % 1000) * 1000;
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+            // Bỏ qua request line/header: path nào cũng trả metrics
+            char request[1024];
+            if (recv(client, request, sizeof(request), 0) <= 0) {
+                ::close(client);
+                continue;
+            }
+
+            std::string body = render();
+            std::string response = "HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: text/plain; version=0.0.4\r\n"
+                                   "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                                   "Connection: close\r\n\r\n" + body;
+            size_t offset = 0;
+            while (offset < response.size()) {
+                ssize_t n = send(client, response.data() + offset, response.size() - offset, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                offset += static_cast<size_t>(n);
+            }
+            ::close(client);
+        }
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+🕒 Virtual clock cho ESP32 Simulator
+- speed = k: thời gian ảo chạy nhanh gấp k lần thời gian thật (k = 1 → như cũ)
+- fast-forward (speed "max"): không chờ, mỗi EventLoop nhảy thẳng tới deadline kế tiếp
+- nowMs(): mốc monotonic ảo cho scheduler/debounce; epochMs(): wall-clock ảo cho giờ cao điểm/log/payload
+*/
+#ifndef SIM_SIM_CLOCK_H
+#define SIM_SIM_CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class SimClock {
+public:
+    // speed <= 0 → fast-forward; startEpochMs <= 0 → bắt đầu từ giờ thật
+    static void configure(double speed, int64_t startEpochMs) {
+        State& s = state();
+        s.realStartMs = realMs();
+        s.virtualStartMs = s.realStartMs;
+        s.epochStartMs = startEpochMs > 0 ? startEpochMs : realEpochMs();
+        s.speed = speed > 0 ? speed : 0.0;
+        s.maxNowMs.store(s.virtualStartMs);
+    }
+
+    static bool fastForward() { return state().speed == 0.0; }
+    static double speed() { return state().speed; }
+
+    static int64_t realMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Mốc µs thật, dùng để đo latency của load generator
+    static int64_t realUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static int64_t nowMs() {
+        const State& s = state();
+        if (s.speed == 1.0) return realMs();
+        if (fastForward()) {
+            int64_t local = threadNowMs();
+            return local >= 0 ? local : s.maxNowMs.load(std::memory_order_relaxed);
+        }
+        return s.virtualStartMs + static_cast<int64_t>((realMs() - s.realStartMs) * s.speed);
+    }
+
+    static int64_t epochMs() {
+        const State& s = state();
+        return s.epochStartMs + (nowMs() - s.virtualStartMs);
+    }
+
+    // Deadline ảo → steady ns thật (dùng cho timerfd khi speed > 0)
+    static int64_t toRealNs(int64_t virtualMs) {
+        const State& s = state();
+        double realMsValue = s.realStartMs + (virtualMs - s.virtualStartMs) / s.speed;
+        return static_cast<int64_t>(realMsValue * 1000000.0);
+    }
+
+    // Fast-forward: mỗi EventLoop bắt đầu từ mốc gốc, không theo thread đã chạy trước
+    static void beginThread() {
+        threadNowMs() = state().virtualStartMs;
+    }
+
+    // Fast-forward: EventLoop của thread hiện tại đã chạy tới virtualMs
+    static void advanceTo(int64_t virtualMs) {
+        threadNowMs() = virtualMs;
+        std::atomic<int64_t>& maxNow = state().maxNowMs;
+        int64_t seen = maxNow.load(std::memory_order_relaxed);
+        while (seen < virtualMs && !maxNow.compare_exchange_weak(seen, virtualMs)) {
+        }
+    }
+
+private:
+    struct State {
+        int64_t realStartMs = realMs();
+        int64_t virtualStartMs = realStartMs;
+        int64_t epochStartMs = realEpochMs();
+        double speed = 1.0;
+        std::atomic<int64_t> maxNowMs{0};
+    };
+
+    static State& state() {
+        static State s;
+        return s;
+    }
+
+    static int64_t& threadNowMs() {
+        thread_local int64_t now = -1;
+        return now;
+    }
+
+    static int64_t realEpochMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+🧾 Status payload encoder cho ESP32 Simulator
+- Ghi JSON body của PUT /slots/:id/status (và checkin/checkout của load generator)
+  vào buffer cố định bằng std::to_chars
+  → không cấp phát heap, không phụ thuộc locale như ostringstream/setprecision
+- URL từng slot được build sẵn một lần lúc khởi tạo fleet
+*/
+#ifndef SIM_STATUS_ENCODER_H
+#define SIM_STATUS_ENCODER_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// {"status":"available","sensor_id":"ESP32_SLOT_<int>","timestamp":<int64>,"distance":<float>,"simulation":true}
+const size_t STATUS_PAYLOAD_CAPACITY = 192;
+
+class StatusEncoder {
+public:
+    // View chỉ hợp lệ tới lần encode kế tiếp
+    std::string_view encode(int slotId, bool occupied, int64_t epochMs, float distance) {
+        length_ = 0;
+        append("{\"status\":\"");
+        append(occupied ? "occupied" : "available");
+        append("\",\"sensor_id\":\"ESP32_SLOT_");
+        appendNumber(slotId);
+        append("\",\"timestamp\":");
+        appendNumber(epochMs);
+        append(",\"distance\":");
+        // fixed + 1 chữ số thập phân, giống std::fixed << std::setprecision(1)
+        std::to_chars_result r = std::to_chars(buffer_ + length_, buffer_ + sizeof(buffer_), distance,
+                                               std::chars_format::fixed, 1);
+        length_ = static_cast<size_t>(r.ptr - buffer_);
+        append(",\"simulation\":true}");
+        return std::string_view(buffer_, length_);
+    }
+
+    // POST /parking/checkin: {"slot_id":<int>,"license_plate":"SIM-<int>"}
+    std::string_view encodeCheckIn(int slotId) {
+        length_ = 0;
+        append("{\"slot_id\":");
+        appendNumber(slotId);
+        append(",\"license_plate\":\"SIM-");
+        appendNumber(slotId);
+        append("\"}");
+        return std::string_view(buffer_, length_);
+    }
+
+    // POST /parking/checkout: {"slot_id":<int>}
+    std::string_view encodeCheckOut(int slotId) {
+        length_ = 0;
+        append("{\"slot_id\":");
+        appendNumber(slotId);
+        append("}");
+        return std::string_view(buffer_, length_);
+    }
+
+private:
+    char buffer_[STATUS_PAYLOAD_CAPACITY];
+    size_t length_ = 0;
+
+    template <size_t N>
+    void append(const char (&literal)[N]) {
+        std::memcpy(buffer_ + length_, literal, N - 1);
+        length_ += N - 1;
+    }
+
+    void append(const char* text) {
+        size_t n = std::strlen(text);
+        std::memcpy(buffer_ + length_, text, n);
+        length_ += n;
+    }
+
+    template <typename T>
+    void appendNumber(T value) {
+        std::to_chars_result r = std::to_chars(buffer_ + length_, buffer_ + sizeof(buffer_), value);
+        length_ = static_cast<size_t>(r.ptr - buffer_);
+    }
+};
+
+// URL ".../slots/<id>/status" build sẵn cho dải slot của fleet
+class SlotUrlTable {
+public:
+    void init(const std::string& baseUrl, int firstSlotId, int count) {
+        baseUrl_ = baseUrl;
+        firstSlotId_ = firstSlotId;
+        urls_.resize(count > 0 ? count : 0);
+        for (int i = 0; i < count; i++) build(urls_[i], firstSlotId + i);
+    }
+
+    // Slot ngoài dải (ví dụ khi replay trace) → build vào buffer thread_local, tái dùng capacity
+    const std::string& statusUrl(int slotId) const {
+        size_t index = static_cast<size_t>(slotId - firstSlotId_);
+        if (slotId >= firstSlotId_ && index < urls_.size()) return urls_[index];
+        thread_local std::string scratch;
+        build(scratch, slotId);
+        return scratch;
+    }
+
+private:
+    std::string baseUrl_;
+    int firstSlotId_ = 0;
+    std::vector<std::string> urls_;
+
+    void build(std::string& out, int slotId) const {
+        char id[16];
+        std::to_chars_result r = std::to_chars(id, id + sizeof(id), slotId);
+        out.assign(baseUrl_);
+        out.append("/slots/");
+        out.append(id, static_cast<size_t>(r.ptr - id));
+        out.append("/status");
+    }
+};
+
+#endif
@@ -0,0 +1,166 @@
+/*
+🎞️ Trace record/replay cho ESP32 Simulator
+File nhị phân append-only:
+  TraceHeader (32 byte) + N × TraceRecord (24 byte, little-endian, không padding)
+- Mỗi phép đo ghi một record TRACE_MEASURE; mỗi status update ghi thêm một record
+  TRACE_OCCUPIED/TRACE_AVAILABLE kèm HTTP status + latency khi có kết quả
+- Reader dùng mmap và trả bộ nhớ đã đọc cho kernel → replay file nhiều GB không tốn RAM
+- Record nằm theo thứ tự ghi, KHÔNG theo timestampMs (worker fleet có đồng hồ ảo riêng, status record
+  append khi HTTP trả về) → ai cần thứ tự thời gian phải tự sắp (runReplay sắp status record)
+*/
+#ifndef SIM_TRACE_H
+#define SIM_TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char TRACE_MAGIC[8] = {'S', 'P', 'T', 'R', 'A', 'C', 'E', '1'};
+const uint32_t TRACE_VERSION = 1;
+const size_t TRACE_WRITE_BUFFER = 1 << 20;
+const size_t TRACE_RELEASE_CHUNK = 64 << 20;  // trả trang đã replay cho kernel mỗi 64MB
+
+enum TraceEvent : uint8_t {
+    TRACE_MEASURE = 0,
+    TRACE_OCCUPIED = 1,
+    TRACE_AVAILABLE = 2,
+};
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t seed;
+    int64_t startEpochMs;
+};
+
+struct TraceRecord {
+    int64_t timestampMs;    // epoch ms theo SimClock lúc đo/gửi
+    uint32_t slotId;
+    float distance;
+    uint8_t event;          // TraceEvent
+    uint8_t reserved;
+    uint16_t status;        // HTTP status, 0 = lỗi transport/offline
+    uint32_t latencyUs;
+};
+
+static_assert(sizeof(TraceHeader) == 32, "TraceHeader layout");
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord layout");
+
+// fwrite trên cùng FILE* đã được stdio khoá nên các worker ghi chung một file được
+class TraceWriter {
+public:
+    bool open(const std::string& path, uint64_t seed, int64_t startEpochMs) {
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_) return false;
+        std::setvbuf(file_, nullptr, _IOFBF, TRACE_WRITE_BUFFER);
+
+        TraceHeader header{};
+        std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_VERSION;
+        header.recordSize = sizeof(TraceRecord);
+        header.seed = seed;
+        header.startEpochMs = startEpochMs;
+        return std::fwrite(&header, sizeof(header), 1, file_) == 1;
+    }
+
+    ~TraceWriter() { close(); }
+
+    void append(const TraceRecord& record) {
+        if (file_) std::fwrite(&record, sizeof(record), 1, file_);
+    }
+
+    void close() {
+        if (file_) std::fclose(file_);
+        file_ = nullptr;
+    }
+
+private:
+    FILE* file_ = nullptr;
+};
+
+class TraceReader {
+public:
+    ~TraceReader() {
+#ifndef _WIN32
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+#endif
+    }
+
+    bool open(const std::string& path, std::string& error) {
+#ifdef _WIN32
+        (void)path;
+        error = "replay cần mmap (Linux/Mac)";
+        return false;
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0) {
+            error = "không mở được " + path;
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ < sizeof(TraceHeader)) {
+            error = "file trace quá ngắn";
+            return false;
+        }
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED) {
+            error = "mmap thất bại";
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(mapped);
+        madvise(mapped, size_, MADV_SEQUENTIAL);
+
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (std::memcmp(header_.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+            header_.version != TRACE_VERSION || header_.recordSize != sizeof(TraceRecord)) {
+            error = "không phải trace v1";
+            return false;
+        }
+        offset_ = sizeof(TraceHeader);
+        released_ = 0;
+        return true;
+#endif
+    }
+
+    const TraceHeader& header() const { return header_; }
+
+    uint64_t recordCount() const {
+        return size_ < sizeof(TraceHeader) ? 0 : (size_ - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    }
+
+    bool next(TraceRecord& record) {
+        if (offset_ + sizeof(TraceRecord) > size_) return false;
+        std::memcpy(&record, data_ + offset_, sizeof(record));
+        offset_ += sizeof(TraceRecord);
+#ifndef _WIN32
+        if (offset_ - released_ >= TRACE_RELEASE_CHUNK) {
+            size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t end = (offset_ / pageSize) * pageSize;
+            madvise(const_cast<uint8_t*>(data_) + released_, end - released_, MADV_DONTNEED);
+            released_ = end;
+        }
+#endif
+        return true;
+    }
+
+private:
+    TraceHeader header_{};
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t offset_ = 0;
+    size_t released_ = 0;
+    int fd_ = -1;
+};
+
+#endif